@@ -0,0 +1,30 @@
+#ifndef PROJEKT2_BENCH_H
+#define PROJEKT2_BENCH_H
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <iomanip>
+#include <string>
+
+#include "../src/utils.h"
+
+/* Prints result in machine readable form: name,value,unit */
+void report_result(const std::string& name, double value, const std::string& unit) {
+    std::cout << std::fixed << std::setprecision(3) << name << "," << value << "," << unit << std::endl;
+}
+
+/* Returns average time of single call in nanoseconds, best of few runs */
+template<typename Function>
+double measure(uint64_t iterations, Function function, uint32_t runs = 5) {
+    uint64_t best = UINT64_MAX;
+    for (uint32_t run = 0; run < runs; ++run) {
+        uint64_t start = get_time();
+        for (uint64_t i = 0; i < iterations; ++i)
+            function();
+        best = std::min(best, get_time() - start);
+    }
+    return (double) best * 1000 / iterations;
+}
+
+#endif //PROJEKT2_BENCH_H
@@ -0,0 +1,97 @@
+#include <atomic>
+#include <thread>
+#include <unistd.h>
+
+#include "bench.h"
+#include "../src/server_communicator.h"
+
+/*
+ * Catch-up of a client which is far behind: whole log of 1M events
+ * is sent over loopback with plain sendto loop, with UDP segmentation offload
+ * and through io_uring backend. Plain loop is also measured for clients
+ * advertising datagrams of Ethernet and jumbo frame size.
+ */
+
+const uint16_t BENCH_PORT_NUM = 2121;
+const uint32_t BENCH_EVENTS = 1000000;
+
+std::vector<Event> generate_events() {
+    std::vector<Event> events;
+    events.reserve(BENCH_EVENTS);
+    events.emplace_back(0, DEFAULT_SCREEN_WIDTH, DEFAULT_SCREEN_HEIGHT);
+    events.back().add_player("alice");
+    events.back().add_player("bob");
+    while (events.size() < BENCH_EVENTS)
+        events.emplace_back(events.size(), events.size() % 2,
+                            events.size() % DEFAULT_SCREEN_WIDTH,
+                            events.size() % DEFAULT_SCREEN_HEIGHT);
+    return events;
+}
+
+int open_receiver(uint16_t port_num) {
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    int val = 64 << 20;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &val, sizeof(val));
+    struct timeval timeout{0, 200000};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    struct sockaddr_in server_address{};
+    server_address.sin_family = AF_INET;
+    server_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    server_address.sin_port = htons(port_num);
+    connect(sock, (struct sockaddr*) &server_address, sizeof(server_address));
+    return sock;
+}
+
+void run_catchup(const std::vector<Event>& events, uint16_t port_num, bool use_gso,
+                 bool use_io_uring, const std::string& name,
+                 uint16_t datagram_size = MAX_SERVER_DATAGRAM_SIZE) {
+    /* Every run needs own port, communicator never closes its socket */
+    ServerCommunicator communicator(port_num, CLIENTS_MAX_NUMBER, DEFAULT_OBSERVERS_MAX_NUMBER,
+                                    use_gso, use_io_uring);
+    int sock = open_receiver(port_num);
+
+    /* Register observer which hasn't got any event yet */
+    uint8_t message[13 + CLIENT_EXTENSION_SIZE]{};
+    *(uint64_t*) message = htobe64(1);
+    *(uint16_t*)(message + 14) = htons(datagram_size);
+    send(sock, message, datagram_size > MAX_SERVER_DATAGRAM_SIZE ? sizeof(message) : 13, 0);
+    while (communicator.observers.empty()) {
+        communicator.parse_message(events, 0);
+        communicator.flush();
+    }
+
+    std::atomic<uint64_t> datagrams{0}, received_events{0}, last_receive{0};
+    std::thread receiver([&]() {
+        std::vector<uint8_t> buffer(datagram_size);
+        ssize_t len;
+        while ((len = recv(sock, buffer.data(), buffer.size(), 0)) > 0) {
+            for (ssize_t pos = 4; pos < len; pos += ntohl(*(uint32_t*)(buffer.data() + pos)) + 8)
+                received_events++;
+            datagrams++;
+            last_receive = get_time();
+        }
+    });
+
+    uint64_t start = get_time();
+    communicator.send_events(events, 0, 0, communicator.observers[0]);
+    communicator.flush();
+    uint64_t sent = get_time();
+    receiver.join();
+
+    report_result(name + "_send_time", (double) (sent - start) / 1000, "ms");
+    report_result(name + "_catchup_time", (double) (last_receive - start) / 1000, "ms");
+    /* Loopback may drop datagrams, these are counted by receiver */
+    report_result(name + "_received_datagrams", datagrams, "received datagrams");
+    report_result(name + "_received_events", received_events, "received events");
+    close(sock);
+}
+
+int main() {
+    std::vector<Event> events = generate_events();
+    run_catchup(events, BENCH_PORT_NUM, false, false, "catchup_1m_sendto");
+    run_catchup(events, BENCH_PORT_NUM + 1, true, false, "catchup_1m_gso");
+    run_catchup(events, BENCH_PORT_NUM + 2, false, true, "catchup_1m_io_uring");
+    run_catchup(events, BENCH_PORT_NUM + 3, false, false, "catchup_1m_sendto_1472", 1472);
+    run_catchup(events, BENCH_PORT_NUM + 4, false, false, "catchup_1m_sendto_8972", 8972);
+}
@@ -0,0 +1,265 @@
+#include <random>
+
+#include "bench.h"
+#include "../src/events.h"
+
+/*
+ * Event codec built from WireSchema compared with hand written one it
+ * replaced, kept here as reference. Random events of every type go through
+ * serialization and both decoders, their bytes have to be the same as from
+ * reference and decoded fields the same as encoded ones.
+ */
+
+const uint64_t BENCH_ITERATIONS = 1000000;
+const uint32_t BENCH_ROUND_TRIPS = 100000;
+const uint32_t BENCH_SEED = 2021;
+
+volatile uint64_t sink; // Keeps results of measured calls alive
+volatile uint32_t source; // Event number read anew by every call, so it can't be hoisted
+
+/* Codec before WireSchema */
+namespace reference {
+
+    void write_uint32(uint8_t* buffer, uint32_t& pos, uint32_t val) {
+        *(uint32_t*)(buffer + pos) = htonl(val);
+        pos += sizeof(val);
+    }
+
+    uint32_t get_length(const Event& event) {
+        uint32_t length = 0;
+        switch (event.event_type) {
+            case NEW_GAME:
+                length = 13;
+                break;
+            case PIXEL:
+                length = 14;
+                break;
+            case PLAYER_ELIMINATED:
+                length = 6;
+                break;
+            case GAME_OVER:
+                length = 5;
+                break;
+        }
+        if (event.event_type == NEW_GAME) {
+            for (const std::string& player_name : event.player_names)
+                length += (player_name.size() + 1);
+        }
+        return length;
+    }
+
+    uint32_t serialize(const Event& event, uint8_t* buffer) {
+        uint32_t pos = 0;
+        write_uint32(buffer, pos, get_length(event));
+        write_uint32(buffer, pos, event.event_no);
+        buffer[pos++] = event.event_type;
+        switch (event.event_type) {
+            case NEW_GAME:
+                write_uint32(buffer, pos, event.x);
+                write_uint32(buffer, pos, event.y);
+                for (const auto& name : event.player_names) {
+                    for (char c : name)
+                        buffer[pos++] = c;
+                    buffer[pos++] = '\0';
+                }
+                break;
+            case PIXEL:
+                buffer[pos++] = event.player_number;
+                write_uint32(buffer, pos, event.x);
+                write_uint32(buffer, pos, event.y);
+                break;
+            case PLAYER_ELIMINATED:
+                buffer[pos++] = event.player_number;
+                break;
+        }
+        write_uint32(buffer, pos, generate_crc32(buffer, pos));
+        return pos;
+    }
+
+    uint32_t decode(DecodedEvent& event, const uint8_t* datagram, uint32_t parsed_len, ssize_t len) {
+        uint32_t event_pos = parsed_len;
+        uint32_t event_len = parsed_len + 4 <= len ?
+                             ntohl(*(uint32_t*)(datagram + parsed_len)) : 0;
+        if (event_len < 5 || event_len + 8 > len - parsed_len) {
+            event.crc32_valid = false;
+            return len;
+        }
+        event.event_no = ntohl(*(uint32_t*)(datagram + parsed_len + 4));
+        event.event_type = *(uint8_t *)(datagram + parsed_len + 8);
+        parsed_len += 9;
+        switch (event.event_type) {
+            case NEW_GAME:
+                event.x =  ntohl(*(uint32_t*)(datagram + parsed_len));
+                event.y =  ntohl(*(uint32_t*)(datagram + parsed_len + 4));
+                parsed_len += 8;
+                event.names.clear();
+                event.names.emplace_back();
+                for (; parsed_len < event_pos + 4 + event_len; ++parsed_len) {
+                    if (datagram[parsed_len] == '\0')
+                        event.names.emplace_back();
+                    else
+                        event.names.back().push_back(datagram[parsed_len]);
+                }
+                event.names.pop_back();
+                break;
+            case PIXEL:
+                event.player_number = *(uint8_t *)(datagram + parsed_len);
+                event.x =  ntohl(*(uint32_t*)(datagram + parsed_len + 1));
+                event.y =  ntohl(*(uint32_t*)(datagram + parsed_len + 5));
+                break;
+            case PLAYER_ELIMINATED:
+                event.player_number = *(uint8_t *)(datagram + parsed_len);
+                break;
+        }
+        parsed_len = event_pos + 4 + event_len;
+        uint32_t crc32 = ntohl(*(uint32_t*)(datagram + parsed_len));
+        event.crc32_valid = (crc32 == generate_crc32(datagram + event_pos, event_len + 4));
+        return parsed_len + 4;
+    }
+
+}
+
+std::vector<Event> get_random_events(uint32_t number) {
+    std::mt19937 rand(BENCH_SEED);
+    std::vector<Event> events;
+    for (uint32_t event_no = 0; event_no < number; ++event_no) {
+        switch (rand() % 4) {
+            case NEW_GAME:
+                events.emplace_back(event_no, rand(), rand());
+                for (uint32_t players = 2 + rand() % (CLIENTS_MAX_NUMBER - 1); players > 0; --players) {
+                    std::string name(1 + rand() % MAX_NAME_LENGTH, ' ');
+                    for (char& c : name)
+                        c = (char) ('!' + rand() % ('~' - '!' + 1)); // Characters allowed in names
+                    events.back().add_player(name);
+                }
+                break;
+            case PIXEL:
+                events.emplace_back(event_no, (uint8_t) rand(), rand(), rand());
+                break;
+            case PLAYER_ELIMINATED:
+                events.emplace_back(event_no, (uint8_t) rand());
+                break;
+            default:
+                events.emplace_back(event_no);
+        }
+    }
+    return events;
+}
+
+bool is_same(const Event& event, const DecodedEvent& decoded) {
+    if (!decoded.crc32_valid || decoded.event_no != event.event_no ||
+        decoded.event_type != event.event_type)
+        return false;
+    switch (event.event_type) {
+        case NEW_GAME:
+            return decoded.x == event.x && decoded.y == event.y && decoded.names == event.player_names;
+        case PIXEL:
+            return decoded.player_number == event.player_number &&
+                   decoded.x == event.x && decoded.y == event.y;
+        case PLAYER_ELIMINATED:
+            return decoded.player_number == event.player_number;
+        default:
+            return true;
+    }
+}
+
+bool is_same(const Event& event, const Event& rebuilt) {
+    return rebuilt.event_no == event.event_no && rebuilt.event_type == event.event_type &&
+           rebuilt.x == event.x && rebuilt.y == event.y &&
+           rebuilt.player_number == event.player_number &&
+           rebuilt.player_names == event.player_names;
+}
+
+/* Returns number of events which didn't survive the round trip */
+uint32_t run_round_trips(const std::vector<Event>& events) {
+    uint8_t record[MAX_SERVER_DATAGRAM_SIZE], reference_record[MAX_SERVER_DATAGRAM_SIZE];
+    uint32_t failures{};
+    DecodedEvent decoded;
+    std::vector<Event> rebuilt;
+    for (const Event& event : events) {
+        uint32_t len = event.serialize(record);
+        bool ok = len == event.get_length() + 8 && len == reference::get_length(event) + 8 &&
+                  len == reference::serialize(event, reference_record) &&
+                  memcmp(record, reference_record, len) == 0;
+
+        ok = ok && decoded.decode(record, 0, len) == len && is_same(event, decoded);
+        ok = ok && append_event_from_record(rebuilt, record) && is_same(event, rebuilt.back());
+
+        /* Record cut anywhere is rejected instead of read past its end */
+        for (uint32_t cut_len = 0; ok && cut_len < len; ++cut_len)
+            ok = decoded.decode(record, 0, cut_len) == cut_len && !decoded.crc32_valid;
+        failures += !ok;
+    }
+    return failures;
+}
+
+/* Returns number of records with length field pointing outside datagram which were accepted */
+uint32_t run_bad_lengths() {
+    uint8_t datagram[MAX_SERVER_DATAGRAM_SIZE]{};
+    uint32_t len = 4 + Event(0, 7, 320, 240).serialize(datagram + 4);
+    std::vector<uint32_t> bad_lengths{0, 4, len - 4 - 8 + 1, INT32_MAX, UINT32_MAX - 16};
+    for (uint32_t wrap = 8; wrap > 0; --wrap)
+        bad_lengths.push_back(UINT32_MAX - wrap + 1); // event_len + 8 wraps in 32 bits
+
+    uint32_t failures{};
+    DecodedEvent decoded;
+    for (uint32_t bad_length : bad_lengths) {
+        store_wire<uint32_t>(datagram + 4, bad_length);
+        failures += decoded.decode(datagram, 4, len) != len || decoded.crc32_valid;
+    }
+    return failures;
+}
+
+int main() {
+    std::vector<Event> events;
+    events.emplace_back(0, DEFAULT_SCREEN_WIDTH, DEFAULT_SCREEN_HEIGHT);
+    for (uint32_t i = 0; i < CLIENTS_MAX_NUMBER; ++i)
+        events.back().add_player("player" + std::string(i < 10 ? "0" : "") + std::to_string(i));
+    events.emplace_back(1, 7, 320, 240);
+
+    uint8_t datagram[MAX_SERVER_DATAGRAM_SIZE];
+    for (uint32_t i : {1, 0}) {
+        std::string name = i == 0 ? "new_game_25" : "pixel";
+        source = i;
+        report_result("codec_reference_serialize_" + name, measure(BENCH_ITERATIONS, [&]() {
+            sink = reference::serialize(events[source], datagram);
+        }), "ns");
+        report_result("codec_schema_serialize_" + name, measure(BENCH_ITERATIONS, [&]() {
+            sink = events[source].serialize(datagram);
+        }), "ns");
+
+        uint32_t len = events[i].serialize(datagram);
+        DecodedEvent event;
+        report_result("codec_reference_decode_" + name, measure(BENCH_ITERATIONS, [&]() {
+            sink = reference::decode(event, datagram, 0, len);
+        }), "ns");
+        report_result("codec_schema_decode_" + name, measure(BENCH_ITERATIONS, [&]() {
+            sink = event.decode(datagram, 0, len);
+        }), "ns");
+    }
+
+    /* Without crc32, which takes most of the time of small records */
+    source = 1;
+    report_result("codec_reference_fields_pixel", measure(BENCH_ITERATIONS, [&]() {
+        const Event& event = events[source];
+        uint32_t pos = 0;
+        reference::write_uint32(datagram, pos, reference::get_length(event));
+        reference::write_uint32(datagram, pos, event.event_no);
+        datagram[pos++] = event.event_type;
+        datagram[pos++] = event.player_number;
+        reference::write_uint32(datagram, pos, event.x);
+        reference::write_uint32(datagram, pos, event.y);
+        sink = pos + datagram[pos - 1];
+    }), "ns");
+    report_result("codec_schema_fields_pixel", measure(BENCH_ITERATIONS, [&]() {
+        const Event& event = events[source];
+        uint32_t pos = PixelWire::encode(datagram, event.event_no, 0, event.player_number,
+                                         event.x, event.y);
+        sink = pos + datagram[pos - 1];
+    }), "ns");
+
+    std::vector<Event> random_events = get_random_events(BENCH_ROUND_TRIPS);
+    report_result("codec_round_trip_events", random_events.size(), "events");
+    report_result("codec_round_trip_failures", run_round_trips(random_events), "events");
+    report_result("codec_bad_length_failures", run_bad_lengths(), "events");
+}
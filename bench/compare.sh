@@ -0,0 +1,54 @@
+#!/bin/sh
+# Compares benchmark results with baseline, both in name,value,unit lines.
+# Times (ns, us, ms) and events per 1000 operations (x/kop) may grow and
+# rates (x/s) may drop by BENCH_TOLERANCE percent (default 25, loopback
+# end-to-end results BENCH_E2E_TOLERANCE, default 40, starts of games, which
+# mostly allocate, BENCH_ALLOC_TOLERANCE, default 60). Times also have to
+# grow by more than BENCH_TIME_FLOOR nanoseconds (default 20), so jitter of
+# calls taking a few nanoseconds isn't a regression. Shares (%) depend on
+# the host, e.g. on transparent huge pages, and are only printed. Counts of
+# what came over loopback (received x) may drop by BENCH_LOSS_TOLERANCE
+# percent (default 1) with lost datagrams, but never grow. Other values are
+# counts and have to be equal.
+# Prints name,value,baseline,change,status and exits with 1 on regression.
+RESULTS=$1
+BASELINE=$2
+if [ ! -f "$BASELINE" ]; then
+    echo "No baseline $BASELINE, save results as baseline with make bench-baseline"
+    exit 0
+fi
+awk -F, -v tolerance="${BENCH_TOLERANCE:-25}" -v e2e_tolerance="${BENCH_E2E_TOLERANCE:-40}" \
+    -v alloc_tolerance="${BENCH_ALLOC_TOLERANCE:-60}" -v loss_tolerance="${BENCH_LOSS_TOLERANCE:-1}" \
+    -v time_floor="${BENCH_TIME_FLOOR:-20}" '
+    BEGIN { ns["ns"] = 1; ns["us"] = 1000; ns["ms"] = 1000000 }
+    NR == FNR { baseline[$1] = $2; next }
+    !($1 in baseline) { print $1 "," $2 ",," "," "new"; next }
+    {
+        change = baseline[$1] == 0 ? 0 : ($2 - baseline[$1]) * 100 / baseline[$1]
+        allowed = $1 ~ /^e2e_/ ? e2e_tolerance : $1 ~ /^start_game_/ ? alloc_tolerance : tolerance
+        status = "ok"
+        if ($3 in ns) {
+            if (change > allowed && ($2 - baseline[$1]) * ns[$3] > time_floor)
+                status = "REGRESSION"
+        }
+        else if ($3 ~ /\/kop$/) {
+            if (change > allowed)
+                status = "REGRESSION"
+        }
+        else if ($3 == "%")
+            status = "info"
+        else if ($3 ~ /\/s$/) {
+            if (-change > allowed)
+                status = "REGRESSION"
+        }
+        else if ($3 ~ /^received /) {
+            if (change > 0 || -change > loss_tolerance)
+                status = "CHANGED"
+        }
+        else if ($2 != baseline[$1])
+            status = "CHANGED"
+        if (status == "REGRESSION" || status == "CHANGED")
+            failed = 1
+        printf "%s,%s,%s,%+.1f%%,%s\n", $1, $2, baseline[$1], change, status
+    }
+    END { exit failed }' "$BASELINE" "$RESULTS"
@@ -0,0 +1,17 @@
+#!/bin/sh
+# Server and load generator over loopback, game at the highest speed with
+# every client slot taken. Prints results like other benchmarks: name,value,unit
+PORT=2131
+./screen-worms-server -p $PORT -s 2021 -v 250 > /dev/null 2>&1 &
+SERVER=$!
+sleep 0.2
+./screen-worms-loadgen localhost -p $PORT -c 2 -o 23 -d 10 | awk '
+    /^Server throughput/ {
+        printf "e2e_datagrams,%.3f,datagrams/s\n", $3
+        printf "e2e_delivered_events,%.3f,events/s\n", $7
+    }
+    /^Delivery latency/ {
+        sub("us", "", $6)
+        printf "e2e_latency_avg,%.3f,us\n", $6
+    }'
+kill $SERVER
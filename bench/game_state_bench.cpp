@@ -0,0 +1,42 @@
+#include "bench.h"
+#include "../src/game_state.h"
+
+/*
+ * Simulation on the default 640x480 board with game state specialized for it
+ * and with dynamic one. Both play the same games, as seed is the same.
+ * Worms go straight until they crash.
+ */
+
+const uint32_t BENCH_GAMES = 2000;
+const uint32_t BENCH_SEED = 2021;
+
+template<uint32_t WIDTH, uint32_t HEIGHT>
+void run_games(const std::string& name) {
+    static GameState<WIDTH, HEIGHT> game_state(BENCH_SEED); // Too big for stack
+    uint64_t round_time{}, rounds{}, events{};
+    std::vector<std::string> players_names;
+    for (uint8_t i = 0; i < CLIENTS_MAX_NUMBER; ++i)
+        players_names.push_back("player" + std::string(i < 10 ? "0" : "") + std::to_string(i));
+    uint8_t turn_directions[CLIENTS_MAX_NUMBER];
+    memset(turn_directions, NO_CHANGES, sizeof(turn_directions));
+
+    for (uint32_t game = 0; game < BENCH_GAMES; ++game) {
+        bool game_rolling = game_state.start_game(players_names, DEFAULT_SCREEN_WIDTH,
+                                                  DEFAULT_SCREEN_HEIGHT,
+                                                  DEFAULT_TURNING_SPEED);
+
+        uint64_t start = get_time();
+        for (; game_rolling; ++rounds)
+            game_rolling = game_state.finish_round(turn_directions);
+        round_time += get_time() - start;
+        events += game_state.events.size();
+    }
+
+    report_result(name + "_finish_round", (double) round_time * 1000 / rounds, "ns");
+    report_result(name + "_events", events, "events");
+}
+
+int main() {
+    run_games<DEFAULT_SCREEN_WIDTH, DEFAULT_SCREEN_HEIGHT>("specialized");
+    run_games<DYNAMIC_BOARD, DYNAMIC_BOARD>("dynamic");
+}
@@ -0,0 +1,126 @@
+#include <random>
+
+#include "bench.h"
+#include "../src/events.h"
+#include "../src/game_state.h"
+
+/*
+ * Hot spots of server and client measured one by one: crc32 of full
+ * datagram, record length and serialization, decoding by client, game start
+ * with board reset and rounds with different numbers of worms and boards.
+ */
+
+const uint64_t BENCH_ITERATIONS = 1000000;
+const uint32_t BENCH_GAMES = 200;
+const uint32_t BENCH_START_RUNS = 5; // Game start is timed in the fastest of them
+const uint32_t BENCH_SEED = 2021;
+const uint32_t BENCH_DIRECTIONS_ROUNDS = 4096; // Random directions repeat after that
+
+volatile uint64_t sink; // Keeps results of measured calls alive
+volatile uint32_t source; // Event number read anew by every call, so it can't be hoisted
+
+std::vector<std::string> get_players_names(uint32_t players) {
+    std::vector<std::string> players_names;
+    for (uint32_t i = 0; i < players; ++i)
+        players_names.push_back("player" + std::string(i < 10 ? "0" : "") + std::to_string(i));
+    return players_names;
+}
+
+void run_codec() {
+    uint8_t datagram[MAX_SERVER_DATAGRAM_SIZE];
+    for (size_t i = 0; i < sizeof(datagram); ++i)
+        datagram[i] = i * 31;
+    report_result("crc32_550_bytes", measure(BENCH_ITERATIONS, [&]() {
+        sink = generate_crc32(datagram, sizeof(datagram));
+    }), "ns");
+
+    std::vector<Event> events;
+    events.emplace_back(0, DEFAULT_SCREEN_WIDTH, DEFAULT_SCREEN_HEIGHT);
+    for (const auto& name : get_players_names(CLIENTS_MAX_NUMBER))
+        events.back().add_player(name);
+    events.emplace_back(1, 7, 320, 240);
+
+    source = 1;
+    report_result("get_length_pixel", measure(BENCH_ITERATIONS, [&]() {
+        sink = get_record_length(events, source);
+    }), "ns");
+    report_result("serialize_pixel", measure(BENCH_ITERATIONS, [&]() {
+        sink = serialize_record(events, source, datagram + 4);
+    }), "ns");
+    source = 0;
+    report_result("get_length_new_game_25", measure(BENCH_ITERATIONS, [&]() {
+        sink = get_record_length(events, source);
+    }), "ns");
+    report_result("serialize_new_game_25", measure(BENCH_ITERATIONS, [&]() {
+        sink = serialize_record(events, source, datagram + 4);
+    }), "ns");
+
+    /* Client decodes datagram full of pixels, time is per record */
+    uint32_t len = 4, records = 0;
+    while (len + get_record_length(events, 1) <= MAX_SERVER_DATAGRAM_SIZE) {
+        len += serialize_record(events, 1, datagram + len);
+        records++;
+    }
+    DecodedEvent event;
+    report_result("decode_pixel", measure(BENCH_ITERATIONS / records, [&]() {
+        for (uint32_t pos = 4; pos < len; )
+            pos = event.decode(datagram, pos, len);
+        sink = event.crc32_valid;
+    }) / records, "ns");
+
+    len = 4 + serialize_record(events, 0, datagram + 4);
+    report_result("decode_new_game_25", measure(BENCH_ITERATIONS, [&]() {
+        sink = event.decode(datagram, 4, len);
+    }), "ns");
+}
+
+/* Worms steer randomly, so games last longer than with going straight */
+template<uint32_t WIDTH, uint32_t HEIGHT>
+void run_games(uint32_t players, uint32_t maxx, uint32_t maxy) {
+    static GameState<WIDTH, HEIGHT> game_state(BENCH_SEED); // Too big for stack
+    std::string name = std::to_string(players) + "_worms_" + std::to_string(maxx) + "x" +
+                       std::to_string(maxy) + (WIDTH == DYNAMIC_BOARD ? "_dynamic" : "");
+    std::vector<std::string> players_names = get_players_names(players);
+    std::mt19937 random_generator(BENCH_SEED);
+    std::vector<uint8_t> turn_directions(BENCH_DIRECTIONS_ROUNDS * CLIENTS_MAX_NUMBER);
+    for (auto& turn_direction : turn_directions)
+        turn_direction = random_generator() % 3;
+    uint64_t start_time{}, best_start_time = UINT64_MAX, round_time{}, rounds{};
+    const uint32_t run_games = BENCH_GAMES / BENCH_START_RUNS;
+
+    for (uint32_t game = 0; game < BENCH_GAMES; ++game) {
+        uint64_t start = get_time();
+        bool game_rolling = game_state.start_game(players_names, maxx, maxy,
+                                                  DEFAULT_TURNING_SPEED);
+        start_time += get_time() - start;
+        if ((game + 1) % run_games == 0) {
+            /* The first run also pays for page faults of a fresh board */
+            best_start_time = std::min(best_start_time, start_time);
+            start_time = 0;
+        }
+
+        start = get_time();
+        for (; game_rolling; ++rounds)
+            game_rolling = game_state.finish_round(
+                    turn_directions.data() +
+                    rounds % BENCH_DIRECTIONS_ROUNDS * CLIENTS_MAX_NUMBER);
+        round_time += get_time() - start;
+    }
+
+    report_result("start_game_" + name, (double) best_start_time * 1000 / run_games, "ns");
+    report_result("finish_round_" + name, (double) round_time * 1000 / rounds, "ns");
+}
+
+int main() {
+    run_codec();
+    run_games<DEFAULT_SCREEN_WIDTH, DEFAULT_SCREEN_HEIGHT>(2, DEFAULT_SCREEN_WIDTH,
+                                                           DEFAULT_SCREEN_HEIGHT);
+    run_games<DEFAULT_SCREEN_WIDTH, DEFAULT_SCREEN_HEIGHT>(10, DEFAULT_SCREEN_WIDTH,
+                                                           DEFAULT_SCREEN_HEIGHT);
+    run_games<DEFAULT_SCREEN_WIDTH, DEFAULT_SCREEN_HEIGHT>(CLIENTS_MAX_NUMBER,
+                                                           DEFAULT_SCREEN_WIDTH,
+                                                           DEFAULT_SCREEN_HEIGHT);
+    run_games<1024, 768>(CLIENTS_MAX_NUMBER, 1024, 768);
+    run_games<DYNAMIC_BOARD, DYNAMIC_BOARD>(CLIENTS_MAX_NUMBER, MAX_SCREEN_WIDTH,
+                                            MAX_SCREEN_HEIGHT);
+}
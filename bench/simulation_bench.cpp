@@ -0,0 +1,93 @@
+#include <random>
+
+#include "bench.h"
+#include "../src/batch_simulation.h"
+
+/*
+ * Rounds per second of batch simulation with one thread and with
+ * BENCH_THREADS threads, fixed so that results of different hosts compare.
+ * Games which ended are restarted before every step and players steer
+ * randomly. First games of the batch are also played one by one with
+ * GameState and their events have to be identical.
+ */
+
+const uint32_t BENCH_GAMES = 4096;
+const uint32_t BENCH_STEPS = 1000;
+const uint32_t BENCH_CHECKED_GAMES = 8;
+const uint32_t BENCH_BOARD_SIZE = 128;
+const uint32_t BENCH_THREADS = 4;
+
+void run_simulation(uint32_t threads_number, const std::string& name) {
+    std::vector<uint32_t> seeds(BENCH_GAMES);
+    for (uint32_t game = 0; game < BENCH_GAMES; ++game)
+        seeds[game] = game + 1;
+    BatchSimulation simulation(seeds.data(), BENCH_GAMES, threads_number);
+    std::vector<GameState<>> checked_games;
+    for (uint32_t game = 0; game < BENCH_CHECKED_GAMES; ++game)
+        checked_games.emplace_back(seeds[game]);
+
+    std::vector<std::string> players_names = {"alice", "bob", "carol", "dave"};
+    std::vector<uint8_t> games_rolling(BENCH_GAMES), turn_directions(BENCH_GAMES * CLIENTS_MAX_NUMBER);
+    std::mt19937 random_generator(BENCH_GAMES);
+    uint8_t batch_events[BENCH_CHECKED_GAMES][MAX_SERVER_DATAGRAM_SIZE * 4];
+    uint8_t checked_events[MAX_SERVER_DATAGRAM_SIZE * 4];
+    size_t batch_len[BENCH_CHECKED_GAMES];
+    uint64_t simulation_time{}, rounds{};
+    bool identical = true;
+
+    for (uint32_t step = 0; step < BENCH_STEPS; ++step) {
+        for (auto& turn_direction : turn_directions)
+            turn_direction = random_generator() % 3;
+        std::vector<uint8_t> were_rolling = games_rolling;
+
+        uint64_t start = get_time();
+        simulation.start_games(players_names, BENCH_BOARD_SIZE, BENCH_BOARD_SIZE,
+                               DEFAULT_TURNING_SPEED, games_rolling.data());
+        simulation_time += get_time() - start;
+        for (uint32_t game = 0; game < BENCH_CHECKED_GAMES; ++game)
+            batch_len[game] = simulation.get_new_events(game, batch_events[game],
+                                                        sizeof(batch_events[game]));
+        for (uint8_t game_rolling : games_rolling)
+            rounds += game_rolling;
+
+        start = get_time();
+        simulation.step(turn_directions.data(), games_rolling.data());
+        simulation_time += get_time() - start;
+        for (uint32_t game = 0; game < BENCH_CHECKED_GAMES; ++game)
+            batch_len[game] += simulation.get_new_events(
+                    game, batch_events[game] + batch_len[game],
+                    sizeof(batch_events[game]) - batch_len[game]);
+
+        /* The same with plain GameState, events of both calls are compared */
+        for (uint32_t game = 0; game < BENCH_CHECKED_GAMES; ++game) {
+            GameState<>& checked_game = checked_games[game];
+            uint32_t first_event_no = checked_game.events.size();
+            bool game_rolling = were_rolling[game];
+            if (!game_rolling) {
+                game_rolling = checked_game.start_game(players_names, BENCH_BOARD_SIZE,
+                                                       BENCH_BOARD_SIZE, DEFAULT_TURNING_SPEED);
+                first_event_no = 0;
+            }
+            if (game_rolling)
+                game_rolling = checked_game.finish_round(
+                        turn_directions.data() + game * CLIENTS_MAX_NUMBER);
+
+            size_t checked_len = 0;
+            for (uint32_t event_no = first_event_no; event_no < checked_game.events.size(); ++event_no)
+                checked_len += serialize_record(checked_game.events, event_no,
+                                                checked_events + checked_len);
+            identical = identical && game_rolling == games_rolling[game] &&
+                        checked_len == batch_len[game] &&
+                        memcmp(checked_events, batch_events[game], checked_len) == 0 &&
+                        checked_game.game_id == simulation.get_game_id(game);
+        }
+    }
+
+    report_result(name + "_rounds", (double) rounds * 1000000 / simulation_time, "rounds/s");
+    report_result(name + "_identical", identical, "bool");
+}
+
+int main() {
+    run_simulation(1, "simulation_1_thread");
+    run_simulation(BENCH_THREADS, "simulation_" + std::to_string(BENCH_THREADS) + "_threads");
+}
@@ -0,0 +1,108 @@
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "bench.h"
+#include "../src/consts.h"
+#include "../src/game_memory.h"
+
+/*
+ * Collision checks of many games on the biggest boards: random pixel reads
+ * spread over grids of 2048x2048. Grids from operator new are compared with
+ * game memory on huge pages. dTLB misses are counted when the kernel gives
+ * access to the hardware counter, share of grid memory on huge pages is read
+ * from /proc/self/smaps_rollup.
+ */
+
+const uint32_t BENCH_GRIDS = 16;
+const size_t BENCH_GRID_SIZE = (size_t) MAX_SCREEN_WIDTH * MAX_SCREEN_HEIGHT;
+const uint32_t BENCH_ACCESSES = 1 << 20;
+const uint32_t BENCH_SEED = 2021;
+
+volatile uint64_t sink; // Keeps results of measured reads alive
+
+/* Returns -1 when dTLB misses can't be counted */
+int open_dtlb_counter() {
+    struct perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* AnonHugePages with Private_Hugetlb of the process in kB */
+uint64_t get_huge_pages_kb() {
+    std::ifstream smaps("/proc/self/smaps_rollup");
+    std::string field;
+    uint64_t value, total{};
+    smaps.ignore(256, '\n'); // Address range
+    while (smaps >> field >> value) {
+        if (field == "AnonHugePages:" || field == "Private_Hugetlb:")
+            total += value;
+        smaps.ignore(16, '\n');
+    }
+    return total;
+}
+
+template<typename Grids>
+void run_reads(const std::string& name, Grids& grids,
+               const std::vector<std::pair<uint32_t, uint32_t>>& accesses) {
+    auto read_all = [&]() {
+        uint64_t pixel{}; // Next read waits for previous one, like checks of worm moves
+        for (auto [grid, offset] : accesses)
+            pixel = grids[grid][offset ^ pixel];
+        sink = pixel;
+    };
+    report_result(name + "_random_read", measure(1, read_all) / accesses.size(), "ns");
+
+    int counter = open_dtlb_counter();
+    if (counter < 0) {
+        std::cerr << name << ": dTLB misses not counted, no access to hardware counter" << std::endl;
+        return;
+    }
+    ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+    ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+    read_all();
+    ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+    uint64_t misses{};
+    if (read(counter, &misses, sizeof(misses)) == sizeof(misses))
+        report_result(name + "_dtlb_misses", (double) misses * 1000 / accesses.size(), "misses/kop");
+    close(counter);
+}
+
+int main() {
+    std::mt19937 rand(BENCH_SEED);
+    std::vector<std::pair<uint32_t, uint32_t>> accesses;
+    for (uint32_t i = 0; i < BENCH_ACCESSES; ++i)
+        accesses.emplace_back(rand() % BENCH_GRIDS, rand() % BENCH_GRID_SIZE);
+
+    {
+        std::vector<std::unique_ptr<bool[]>> grids;
+        for (uint32_t i = 0; i < BENCH_GRIDS; ++i) {
+            grids.emplace_back(new bool[BENCH_GRID_SIZE]);
+            memset(grids.back().get(), i & 1, BENCH_GRID_SIZE);
+        }
+        run_reads("tlb_new", grids, accesses);
+    }
+
+    uint64_t huge_pages_kb = get_huge_pages_kb();
+    std::vector<GamePixels> pixels(BENCH_GRIDS);
+    std::vector<bool*> grids;
+    for (uint32_t i = 0; i < BENCH_GRIDS; ++i) {
+        pixels[i].resize(BENCH_GRID_SIZE);
+        memset(pixels[i].get(), i & 1, BENCH_GRID_SIZE);
+        grids.push_back(pixels[i].get());
+    }
+    huge_pages_kb = get_huge_pages_kb() - huge_pages_kb;
+    run_reads("tlb_game_memory", grids, accesses);
+    report_result("tlb_game_memory_huge_pages",
+                  std::min<uint64_t>(100, huge_pages_kb * 1024 * 100 / (BENCH_GRIDS * BENCH_GRID_SIZE)),
+                  "%");
+}
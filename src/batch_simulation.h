@@ -0,0 +1,95 @@
+#ifndef PROJEKT2_BATCH_SIMULATION_H
+#define PROJEKT2_BATCH_SIMULATION_H
+
+#include <string>
+#include <vector>
+
+#include "consts.h"
+#include "game_state.h"
+#include "work_stealing_pool.h"
+
+/*
+ * Headless simulation of many independent games stepped together, e.g. for
+ * bots training. Uses rules of GameState without any networking, so slot
+ * seeded like the server (-s) and given the same players and turn directions
+ * produces the same events, byte for byte. Games are spread over threads of
+ * a work stealing pool.
+ */
+class BatchSimulation {
+
+    std::vector<GameState<>> games;
+    std::vector<uint32_t> first_new_event; // Generated by last call, for every game
+    WorkStealingPool pool;
+
+public:
+
+    /* One game for every seed, 0 threads means one for every core */
+    BatchSimulation(const uint32_t* seeds, uint32_t games_number, uint32_t threads_number = 0)
+                : first_new_event(games_number), pool(threads_number) {
+        games.reserve(games_number);
+        for (uint32_t game = 0; game < games_number; ++game)
+            games.emplace_back(seeds[game]);
+    }
+
+    uint32_t size() const {
+        return games.size();
+    }
+
+    uint32_t threads() const {
+        return pool.size();
+    }
+
+    /*
+     * Starts new game of players sorted alphabetically in every slot with
+     * games_rolling[game] equal to 0 and updates games_rolling.
+     */
+    void start_games(const std::vector<std::string>& players_names, uint32_t maxx,
+                     uint32_t maxy, uint16_t turning_speed, uint8_t* games_rolling) {
+        pool.run(games.size(), [&](uint32_t game) {
+            if (games_rolling[game]) {
+                first_new_event[game] = games[game].events.size();
+                return;
+            }
+            games_rolling[game] = games[game].start_game(players_names, maxx, maxy,
+                                                         turning_speed);
+            first_new_event[game] = 0;
+        });
+    }
+
+    /*
+     * Finishes round of every game with games_rolling[game] different from 0
+     * and updates games_rolling. Directions for game are at
+     * turn_directions[game * CLIENTS_MAX_NUMBER + player_number].
+     */
+    void step(const uint8_t* turn_directions, uint8_t* games_rolling) {
+        pool.run(games.size(), [&](uint32_t game) {
+            first_new_event[game] = games[game].events.size();
+            if (games_rolling[game])
+                games_rolling[game] = games[game].finish_round(
+                        turn_directions + (size_t) game * CLIENTS_MAX_NUMBER);
+        });
+    }
+
+    uint32_t get_game_id(uint32_t game) const {
+        return games[game].game_id;
+    }
+
+    /*
+     * Copies events of game generated by last start_games or step to buffer,
+     * as records of server datagrams. Returns number of bytes written or 0
+     * if they don't fit in size.
+     */
+    size_t get_new_events(uint32_t game, uint8_t* buffer, size_t size) const {
+        const GameEvents& events = games[game].events;
+        size_t written = 0;
+        for (uint32_t event_no = first_new_event[game]; event_no < events.size(); ++event_no) {
+            if (written + get_record_length(events, event_no) > size)
+                return 0;
+            written += serialize_record(events, event_no, buffer + written);
+        }
+        return written;
+    }
+
+};
+
+#endif //PROJEKT2_BATCH_SIMULATION_H
@@ -1,17 +1,17 @@
 #include "client_options.h"
 #include "client_communicator.h"
 #include "utils.h"
+#include "trace_ring.h"
 
 
-[[noreturn]] void run_client(ClientCommunicator& communicator) {
-    uint64_t moment_length = 30000,
-             moment_start = get_time();
+[[noreturn]] void run_client(ClientCommunicator& communicator, bool trace,
+                             const std::string& trace_dump_path) {
+    uint64_t trace_report_start = get_time();
 
     while (true) {
-        if (get_time() - moment_start >= moment_length) {
-            /* Send routine message */
+        if (communicator.is_message_due()) {
+            /* Send change, request for missing events or routine message */
             communicator.message_server();
-            moment_start = get_time();
         }
 
         /* If server sent anything */
@@ -20,6 +20,13 @@
         /* If gui sever sent anything */
         communicator.parse_gui_message();
 
+        if (trace && get_time() - trace_report_start >= TRACE_REPORT_INTERVAL) {
+            communicator.report_trace();
+            trace_report_start = get_time();
+        }
+
+        if (TraceRing::is_dump_requested() && !TraceRing::dump(trace_dump_path))
+            std::cerr << "Dumping trace ring to " << trace_dump_path << " failed!" << std::endl;
     }
 
 }
@@ -28,8 +35,13 @@ int main(int argc, char *argv[])
 {
     uint64_t session_id = get_time();
     ClientOptions client_options = ClientOptions(argc, argv);
+    bool trace = client_options.trace;
     ClientCommunicator communicator =
             ClientCommunicator(client_options, session_id);
+    if (!client_options.trace_dump_path.empty()) {
+        TraceRing::enable();
+        TraceRing::dump_on_signal();
+    }
 
-    run_client(communicator);
+    run_client(communicator, trace, client_options.trace_dump_path);
 }
\ No newline at end of file
@@ -15,16 +15,22 @@
 #include "consts.h"
 #include "client_options.h"
 #include "utils.h"
+#include "events.h"
+#include "latency_histogram.h"
+#include "gui_channel.h"
+#include "trace_ring.h"
 
 class ClientCommunicator {
 
     const ClientOptions client_options;
     const uint64_t session_id;
     uint8_t buffer_w[MAX_CLIENT_DATAGRAM_SIZE]{};
-    uint8_t buffer_r[MAX_SERVER_DATAGRAM_SIZE]{};
-    uint8_t gui_buffer[2 * MAX_SERVER_DATAGRAM_SIZE]{};
+    std::vector<uint8_t> buffer_r; // Of datagram size advertised to server
+    uint8_t gui_buffer[MAX_GUI_RECORD_SIZE]{}; // NEW_GAME fits after checks of its names
     uint16_t gui_buffer_pos{};
     int sock{}, gui_sock{};
+    int multicast_sock = -1; // Live events for observers, when joined
+    GuiChannel gui_channel; // Used instead of gui_sock when active
     struct sockaddr_in srvr_address{};
 
     /* Current game info */
@@ -33,22 +39,42 @@ class ClientCommunicator {
     uint32_t maxx{}, maxy{};
     std::vector<std::string> players_names;
     uint8_t turn_direction{};
+    bool game_active = false, own_worm_alive = false;
+
+    /*
+     * Adaptive sending: at once after turn change or gap in events, then
+     * every CLIENT_MESSAGE_INTERVAL while own worm is in game, otherwise with
+     * interval doubling up to CLIENT_KEEPALIVE_INTERVAL.
+     */
+    bool message_pending = true;
+    uint64_t last_message_time{};
+    uint64_t message_interval = CLIENT_MESSAGE_INTERVAL;
 
     /* Last received message information */
     uint32_t game_id{};
-    uint8_t event_type{};
-    uint32_t event_no{};
-    uint32_t x{}, y{};
-    std::vector<std::string> names;
-    uint8_t player_number{};
-    bool crc32_valid{};
+    DecodedEvent event;
+
+    /* Input tracing, only with -T. Times of last turn change being handled */
+    uint8_t own_player_number = CLIENTS_MAX_NUMBER;
+    uint64_t input_time{}, send_time{};
+    LatencyHistogram input_to_send, send_to_receive, receive_to_gui, input_to_gui;
 
 
 public:
     explicit ClientCommunicator(ClientOptions client_options, uint64_t session_id)
-                    : client_options(std::move(client_options)), session_id(session_id) {
+                    : client_options(std::move(client_options)), session_id(session_id),
+                      buffer_r(this->client_options.datagram_size) {
         init_server_connection();
-        init_gui_server_connection();
+        if (this->client_options.multicast_group.is_enabled())
+            init_multicast_connection();
+        if (this->client_options.gui_channel_path.empty())
+            init_gui_server_connection();
+        else
+            gui_channel.connect_to(this->client_options.gui_channel_path);
+    }
+
+    bool is_message_due() const {
+        return message_pending || get_time() - last_message_time >= message_interval;
     }
 
     void message_server() {
@@ -59,6 +85,12 @@ public:
             buffer_w[13 + i] = client_options.player_name[i];
 
         size_t buffer_len = 13 + client_options.player_name.size();
+        if (client_options.datagram_size > MAX_SERVER_DATAGRAM_SIZE) {
+            /* Only with -D, older servers would take it as part of the name */
+            buffer_w[buffer_len] = '\0';
+            *(uint16_t*)(buffer_w + buffer_len + 1) = htons(client_options.datagram_size);
+            buffer_len += CLIENT_EXTENSION_SIZE;
+        }
         ssize_t rcva_len = (socklen_t) sizeof(srvr_address);
 
         if (sendto(sock, buffer_w, buffer_len, 0,(struct sockaddr*) &srvr_address,
@@ -67,86 +99,157 @@ public:
                       << ":" << srvr_address.sin_port << " failed!" << std::endl;
             report_fail("Sending buffer failed!");
         }
+        TRACE_PROBE(client_send, turn_direction);
+        if (input_time != 0 && send_time == 0) {
+            send_time = get_time();
+            input_to_send.add(send_time - input_time);
+        }
+
+        last_message_time = get_time();
+        message_pending = false;
+        if (game_active && own_worm_alive)
+            message_interval = CLIENT_MESSAGE_INTERVAL;
+        else
+            message_interval = std::min(2 * message_interval, CLIENT_KEEPALIVE_INTERVAL);
     }
 
     void parse_message() {
         auto rcva_len = (socklen_t) sizeof(srvr_address);
-        ssize_t len = recvfrom(sock, buffer_r, sizeof(buffer_r), 0,
+        ssize_t len = recvfrom(sock, buffer_r.data(), buffer_r.size(), 0,
                                (struct sockaddr *) &srvr_address, &rcva_len);
+        if (len == -1 && multicast_sock >= 0)
+            len = receive_multicast();
         if (len == -1)
             return;
+        TRACE_PROBE(client_receive, len);
 
         /* Message received needs to be parsed. Random bytes send
          * (without assigned structure) generate undefined behavior */
-        game_id = ntohl(*(uint32_t*)buffer_r);
+        game_id = ntohl(*(uint32_t*)buffer_r.data());
         uint32_t parsed_len = 4;
 
         while (len > parsed_len) {
-            parsed_len = parse_event(parsed_len);
-
-            if (!crc32_valid)
-                return; // End parsing this datagram
-            if (event_type > GAME_OVER)
+            parsed_len = event.decode(buffer_r.data(), parsed_len, len);
+
+            if (!event.crc32_valid)
+                break; // End parsing this datagram
+            if (!is_next_event())
+                continue; // Duplicate, from other game or after a gap
+            next_expected_event_no = event.event_no + 1;
+            if (event.event_type > GAME_OVER)
                 continue;
 
             /* Known type proper control sum */
 
-            switch (event_type) {
+            switch (event.event_type) {
                 case NEW_GAME:
-                    if (x >= MAX_SCREEN_WIDTH || y >= MAX_SCREEN_HEIGHT)
+                    if (event.x >= MAX_SCREEN_WIDTH || event.y >= MAX_SCREEN_HEIGHT)
                         report_fail("[MESSAGE ERROR] screen size too big");
-                    for (const auto& name : names)
+                    if (event.names.size() > CLIENTS_MAX_NUMBER)
+                        report_fail("[MESSAGE ERROR] too many players");
+                    for (const auto& name : event.names)
                         if (name.empty() || name.size() > MAX_NAME_LENGTH)
                             report_fail("[MESSAGE ERROR] name not valid");
                     init_new_game();
                     message_gui_new_game();
                     break;
                 case PIXEL:
-                    if (game_id != curr_game_id)
-                        report_fail("[MESSAGE ERROR] wrong game id");
-                    if (player_number >= players_names.size())
+                    if (event.player_number >= players_names.size())
                         report_fail("[MESSAGE ERROR] player number too high");
-                    if (x >= maxx || y >= maxy)
+                    if (event.x >= maxx || event.y >= maxy)
                         report_fail("[MESSAGE ERROR] Pixel does not exist");
-                    message_gui_pixel();
+                    if (send_time != 0 && event.player_number == own_player_number)
+                        trace_own_pixel();
+                    else
+                        message_gui_pixel();
                     break;
                 case PLAYER_ELIMINATED:
-                    if (game_id != curr_game_id)
-                        report_fail("[MESSAGE ERROR] wrong game id");
-                    if (player_number >= players_names.size())
+                    if (event.player_number >= players_names.size())
                         report_fail("[MESSAGE ERROR] player number too high");
+                    if (event.player_number == own_player_number)
+                        own_worm_alive = false;
                     message_gui_player_eliminated();
                     break;
                 case GAME_OVER:
-                    if (game_id != curr_game_id)
-                        report_fail("[MESSAGE ERROR] wrong game id");
+                    game_active = false;
                     break;
             }
-            next_expected_event_no = event_no + 1;
         }
-
+        TRACE_PROBE(client_events_end, next_expected_event_no);
     }
 
     void parse_gui_message() {
-        ssize_t rcv_len = read(gui_sock, gui_buffer, sizeof(gui_buffer) - 1);
-        if (rcv_len < 0)
-            return;
-        gui_buffer[rcv_len] = '\0';
+        uint8_t old_turn_direction = turn_direction;
+        if (gui_channel.is_active()) {
+            uint8_t key;
+            while (gui_channel.pop_key(key))
+                handle_key(key);
+        }
+        else {
+            ssize_t rcv_len = read(gui_sock, gui_buffer, sizeof(gui_buffer) - 1);
+            if (rcv_len < 0)
+                return;
+            gui_buffer[rcv_len] = '\0';
+
+            if (!strcmp((const char*)gui_buffer, "LEFT_KEY_DOWN\n"))
+                handle_key(LEFT_KEY_DOWN);
+            if (!strcmp((const char*)gui_buffer, "RIGHT_KEY_DOWN\n"))
+                handle_key(RIGHT_KEY_DOWN);
+            if (!strcmp((const char*)gui_buffer, "LEFT_KEY_UP\n"))
+                handle_key(LEFT_KEY_UP);
+            if (!strcmp((const char*)gui_buffer, "RIGHT_KEY_UP\n"))
+                handle_key(RIGHT_KEY_UP);
+        }
 
-        if (!strcmp((const char*)gui_buffer, "LEFT_KEY_DOWN\n"))
-            turn_direction = LEFT;
-        if (!strcmp((const char*)gui_buffer, "RIGHT_KEY_DOWN\n"))
-            turn_direction = RIGHT;
-        if (!strcmp((const char*)gui_buffer, "LEFT_KEY_UP\n"))
-            turn_direction = FORWARD;
-        if (!strcmp((const char*)gui_buffer, "RIGHT_KEY_UP\n"))
-            turn_direction = FORWARD;
+        if (turn_direction != old_turn_direction) {
+            /* Send change at once and repeat it quickly in case it's lost */
+            message_pending = true;
+            message_interval = CLIENT_MESSAGE_INTERVAL;
+        }
+        if (client_options.trace && turn_direction != old_turn_direction) {
+            /* Trace only newest input */
+            input_time = get_time();
+            send_time = 0;
+        }
+    }
 
+    void report_trace() const {
+        input_to_send.report(std::cerr, "[TRACE] input -> sent to server");
+        send_to_receive.report(std::cerr, "[TRACE] sent to server -> own pixel received");
+        receive_to_gui.report(std::cerr, "[TRACE] own pixel received -> sent to gui");
+        input_to_gui.report(std::cerr, "[TRACE] input -> own pixel sent to gui");
     }
 
 private:
 
+    void handle_key(uint8_t key) {
+        if (key == LEFT_KEY_DOWN)
+            turn_direction = LEFT;
+        else if (key == RIGHT_KEY_DOWN)
+            turn_direction = RIGHT;
+        else if (key == LEFT_KEY_UP || key == RIGHT_KEY_UP)
+            turn_direction = FORWARD;
+    }
+
+    /*
+     * Records for shared memory channel, integers in host byte order:
+     *   NEW_GAME maxx(4) maxy(4) names each ended with '\0'
+     *   PIXEL player_number(1) x(4) y(4)
+     *   PLAYER_ELIMINATED player_number(1)
+     */
     void message_gui_new_game() {
+        if (gui_channel.is_active()) {
+            gui_buffer[0] = NEW_GAME;
+            memcpy(gui_buffer + 1, &maxx, 4);
+            memcpy(gui_buffer + 5, &maxy, 4);
+            gui_buffer_pos = 9;
+            for (const auto& name : players_names) {
+                memcpy(gui_buffer + gui_buffer_pos, name.c_str(), name.size() + 1);
+                gui_buffer_pos += name.size() + 1;
+            }
+            send_record_to_gui();
+            return;
+        }
         std::string gui_message = "NEW_GAME " + std::to_string(maxx) + " " +
                                   std::to_string(maxy);
         for (const auto& name : players_names)
@@ -155,58 +258,89 @@ private:
     }
 
     void message_gui_pixel() {
-        send_to_gui("PIXEL " + std::to_string(x) + " " + std::to_string(y)
-                    + ' ' + players_names[player_number] + '\n');
+        if (gui_channel.is_active()) {
+            gui_buffer[0] = PIXEL;
+            gui_buffer[1] = event.player_number;
+            memcpy(gui_buffer + 2, &event.x, 4);
+            memcpy(gui_buffer + 6, &event.y, 4);
+            gui_buffer_pos = 10;
+            send_record_to_gui();
+            return;
+        }
+        send_to_gui("PIXEL " + std::to_string(event.x) + " " + std::to_string(event.y)
+                    + ' ' + players_names[event.player_number] + '\n');
     }
 
     void message_gui_player_eliminated() {
-        send_to_gui("PLAYER_ELIMINATED " + players_names[player_number] + '\n');
+        if (gui_channel.is_active()) {
+            gui_buffer[0] = PLAYER_ELIMINATED;
+            gui_buffer[1] = event.player_number;
+            gui_buffer_pos = 2;
+            send_record_to_gui();
+            return;
+        }
+        send_to_gui("PLAYER_ELIMINATED " + players_names[event.player_number] + '\n');
     }
 
     void init_new_game() {
         curr_game_id = game_id;
-        players_names = names;
-        maxx = x;
-        maxy = y;
+        players_names = event.names;
+        maxx = event.x;
+        maxy = event.y;
+
+        own_player_number = CLIENTS_MAX_NUMBER;
+        for (size_t i = 0; i < players_names.size(); ++i)
+            if (players_names[i] == client_options.player_name)
+                own_player_number = i;
+
+        game_active = true;
+        own_worm_alive = own_player_number != CLIENTS_MAX_NUMBER;
+        if (own_worm_alive)
+            message_interval = CLIENT_MESSAGE_INTERVAL;
     }
 
-    void send_to_gui(const std::string& gui_message) {
-        gui_buffer_pos = 0;
-        for (char c : gui_message) {
-            gui_buffer[gui_buffer_pos] = c;
-            gui_buffer_pos++;
+    /*
+     * Checks whether received event is the next one of current game.
+     * Missing events are requested at once.
+     */
+    bool is_next_event() {
+        if (event.event_type == NEW_GAME && event.event_no == 0 && game_id != curr_game_id)
+            return true; // New game started
+        if (game_id != curr_game_id) {
+            /* Beginning of new game was lost, maybe with end of the old one, ask for it */
+            game_active = false;
+            next_expected_event_no = 0;
+            message_pending = true;
+            return false;
         }
-        if (write(gui_sock, gui_buffer, gui_buffer_pos) != gui_buffer_pos)
+        if (event.event_no > next_expected_event_no)
+            message_pending = true;
+        return event.event_no == next_expected_event_no;
+    }
+
+    /*
+     * First pixel of own worm after turn change was sent is taken as its
+     * result. It is usually from a round which already used new direction.
+     */
+    void trace_own_pixel() {
+        uint64_t receive_time = get_time();
+        message_gui_pixel();
+        uint64_t gui_time = get_time();
+
+        send_to_receive.add(receive_time - send_time);
+        receive_to_gui.add(gui_time - receive_time);
+        input_to_gui.add(gui_time - input_time);
+        input_time = send_time = 0;
+    }
+
+    void send_to_gui(const std::string& gui_message) {
+        if (write(gui_sock, gui_message.data(), gui_message.size()) != (ssize_t) gui_message.size())
             report_fail("Error while messaging gui server");
     }
 
-    uint32_t parse_event(uint32_t parsed_len) {
-        uint32_t event_pos = parsed_len;
-        uint32_t event_len = ntohl(*(uint32_t*)(buffer_r + parsed_len));
-        event_no = ntohl(*(uint32_t*)(buffer_r + parsed_len + 4));
-        event_type = *(uint8_t *)(buffer_r + parsed_len + 8);
-        parsed_len += 9;
-        switch (event_type) {
-            case NEW_GAME:
-                x =  ntohl(*(uint32_t*)(buffer_r + parsed_len));
-                y =  ntohl(*(uint32_t*)(buffer_r + parsed_len + 4));
-                parsed_len += 8;
-                break;
-            case PIXEL:
-                player_number = *(uint8_t *)(buffer_r + parsed_len);
-                x =  ntohl(*(uint32_t*)(buffer_r + parsed_len + 1));
-                y =  ntohl(*(uint32_t*)(buffer_r + parsed_len + 5));
-                parsed_len += 9;
-                break;
-            case PLAYER_ELIMINATED:
-                player_number = *(uint8_t *)(buffer_r + parsed_len);
-                parsed_len += 1;
-                break;
-        }
-        uint32_t crc32 = ntohl(*(uint32_t*)(buffer_r + parsed_len));
-        crc32_valid = (crc32 == generate_crc32(buffer_r + event_pos,
-                                               event_len + 4));
-        return parsed_len;
+    void send_record_to_gui() {
+        if (!gui_channel.push_event(gui_buffer, gui_buffer_pos))
+            report_fail("Error while messaging gui server");
     }
 
     void init_gui_server_connection() {
@@ -234,6 +368,34 @@ private:
         freeaddrinfo(addr_result);
     }
 
+    /* Datagram of the group sent by our server, -1 if there's none */
+    ssize_t receive_multicast() {
+        struct sockaddr_in sender_address{};
+        auto rcva_len = (socklen_t) sizeof(sender_address);
+        ssize_t len = recvfrom(multicast_sock, buffer_r.data(), buffer_r.size(), 0,
+                               (struct sockaddr *) &sender_address, &rcva_len);
+        if (len == -1 || sender_address.sin_addr.s_addr != srvr_address.sin_addr.s_addr ||
+            sender_address.sin_port != srvr_address.sin_port)
+            return -1;
+        return len;
+    }
+
+    void init_multicast_connection() {
+        const MulticastGroup& group = client_options.multicast_group;
+        multicast_sock = socket(PF_INET, SOCK_DGRAM, 0);
+        if (multicast_sock < 0)
+            report_fail("Socket initialization failed!");
+
+        int val = 1; // Other observers on this host join the same port
+        setsockopt(multicast_sock, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val));
+        if (bind(multicast_sock, (struct sockaddr *) &group.address,
+                 (socklen_t) sizeof(group.address)) < 0)
+            report_fail("Binding multicast socket failed!");
+        if (!group.join(multicast_sock))
+            report_fail("Joining multicast group failed!");
+        fcntl(multicast_sock, F_SETFL, O_NONBLOCK);
+    }
+
     void init_server_connection() {
         struct addrinfo addr_hints{};
         struct addrinfo *addr_result;
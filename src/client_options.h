@@ -6,6 +6,7 @@
 #include <algorithm>
 
 #include "consts.h"
+#include "multicast.h"
 
 class ClientOptions {
 
@@ -16,17 +17,23 @@ public:
     std::string gui_server = DEFAULT_GUI_SERVER;
     std::string gui_port = DEFAULT_GUI_PORT;
     uint16_t gui_port_num = DEFAULT_GUI_PORT_NUM;
+    std::string gui_channel_path{};
+    bool trace = false;
+    std::string trace_dump_path{}; // Empty when trace ring is disabled
+    MulticastGroup multicast_group; // Of observers, disabled by default
+    uint16_t datagram_size = MAX_SERVER_DATAGRAM_SIZE; // Advertised only when bigger
 
     ClientOptions(int argc, char *argv[]) {
         if (argc < 2)
             fail_constructor("Game server not provided!");
         game_server = argv[1];
 
+        int64_t helpy;
         int opt;
         argc -= 1;
         argv++;
 
-        while ((opt = getopt(argc, argv, "n:p:i:r:")) != -1) {
+        while ((opt = getopt(argc, argv, "n:p:i:r:g:TP:M:D:")) != -1) {
             switch (opt) {
                 case 'n':
                     player_name = optarg;
@@ -47,6 +54,26 @@ public:
                     if (gui_port_num < 1 || gui_port_num > MAX_PORT_NUM)
                         fail_constructor("GUI port number invalid!");
                     break;
+                case 'g':
+                    gui_channel_path = optarg;
+                    break;
+                case 'T':
+                    trace = true;
+                    break;
+                case 'P':
+                    trace_dump_path = optarg;
+                    break;
+                case 'M':
+                    if (!multicast_group.parse(optarg))
+                        fail_constructor("Multicast group invalid!");
+                    break;
+                case 'D':
+                    helpy = strtol(optarg, nullptr, 10);
+                    if (helpy < (int64_t) MAX_SERVER_DATAGRAM_SIZE ||
+                        helpy > (int64_t) MAX_UDP_PAYLOAD_SIZE)
+                        fail_constructor("Datagram size invalid!");
+                    datagram_size = helpy;
+                    break;
                 default:
                     fail_constructor("Unrecognized program option!");
             }
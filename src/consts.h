@@ -13,9 +13,18 @@ const char *DEFAULT_GUI_SERVER = "localhost";
 /* Ports limits */
 const uint16_t MAX_PORT_NUM = 65535;
 
-/* Datagram sizes */
+/*
+ * Datagram sizes. Client may end its name with '\0' and size of datagrams it
+ * can receive (2 bytes), server packs datagrams for it up to that size.
+ * Clients which don't send it get MAX_SERVER_DATAGRAM_SIZE.
+ */
 const size_t MAX_SERVER_DATAGRAM_SIZE = 550;
-const size_t MAX_CLIENT_DATAGRAM_SIZE = 33;
+const size_t MAX_CLIENT_DATAGRAM_SIZE = 36;
+const size_t CLIENT_EXTENSION_SIZE = 3;
+const size_t MAX_UDP_PAYLOAD_SIZE = 65507; // Biggest negotiated datagram
+
+/* Max datagrams handed to kernel at once with UDP segmentation offload */
+const uint8_t GSO_MAX_SEGMENTS = 64;
 
 /* Event event_type values */
 const uint8_t NEW_GAME = 0;
@@ -35,6 +44,7 @@ const uint16_t MAX_ROUNDS_PER_SEC = 250;
 const uint32_t MAX_SCREEN_WIDTH = 2048;
 const uint32_t MAX_SCREEN_HEIGHT = 2048;
 const uint8_t MAX_NAME_LENGTH = 20;
+const uint16_t MAX_REPLAY_SPEED = 1000;
 
 /* Communicators messages */
 const uint8_t RECEIVED = 0;
@@ -46,8 +56,49 @@ const uint8_t RIGHT = 1;
 const uint8_t LEFT = 2;
 const uint8_t NO_CHANGES = 3; // When client disconnected
 
-/* Clients limits */
+/* Shared memory channel with user interface, keys sent by user interface */
+const uint32_t GUI_RING_CAPACITY = 1 << 20; // Power of 2
+const size_t MAX_GUI_RECORD_SIZE = MAX_SERVER_DATAGRAM_SIZE;
+const uint8_t LEFT_KEY_DOWN = 0;
+const uint8_t LEFT_KEY_UP = 1;
+const uint8_t RIGHT_KEY_DOWN = 2;
+const uint8_t RIGHT_KEY_UP = 3;
+
+/* Client messages, in microseconds. Server forgets clients silent for 2 s */
+const uint64_t CLIENT_MESSAGE_INTERVAL = 30000;
+const uint64_t CLIENT_KEEPALIVE_INTERVAL = 1500000;
+
+/* Latency tracing, microseconds between reports */
+const uint64_t TRACE_REPORT_INTERVAL = 10000000;
+
+/* Ingress filter, datagrams per second of client and of all unknown endpoints */
+const uint32_t INGRESS_ENDPOINT_RATE = 100; // Clients send ~33
+const uint32_t INGRESS_ENDPOINT_BURST = 20;
+const uint32_t INGRESS_UNKNOWN_BUDGET = 200;
+
+/* Datagrams waiting for full socket, sent in order when it becomes writable */
+const uint32_t SEND_QUEUE_CAPACITY = 4096;
+
+/* Simulation thread with -S, queue capacities (powers of 2) and sleep when idle in microseconds */
+const uint32_t SIMULATION_EVENTS_CAPACITY = 1 << 16;
+const uint32_t SIMULATION_ROUNDS_CAPACITY = 1 << 10;
+const uint64_t SIMULATION_IDLE_SLEEP = 1000;
+
+/* Clients limits, players and observers are kept apart */
 const uint8_t CLIENTS_MAX_NUMBER = 25;
+static_assert(9 + CLIENTS_MAX_NUMBER * (MAX_NAME_LENGTH + 1) <= MAX_GUI_RECORD_SIZE,
+              "NEW_GAME record for user interface doesn't fit");
+const uint32_t DEFAULT_OBSERVERS_MAX_NUMBER = 4096;
+const uint32_t MAX_OBSERVERS_NUMBER = 8192; // With players fits in half of ingress filter table
+const uint64_t OBSERVERS_CHECK_INTERVAL = 500000; // Forgetting silent observers, in microseconds
+const uint32_t OBSERVER_SEND_BATCH = 256; // Datagrams per sendmmsg
+
+/* Load generator parameters */
+const uint32_t DEFAULT_LOADGEN_PLAYERS = 2;
+const uint32_t DEFAULT_LOADGEN_OBSERVERS = 20;
+const uint32_t DEFAULT_LOADGEN_DURATION = 10; // In seconds
+const uint32_t MAX_LOADGEN_SESSIONS = 10000;
+const uint32_t MAX_LOADGEN_FLOOD_RATE = 10000000;
 
 
 #endif //PROJEKT2_CONSTS_H
@@ -1,7 +1,15 @@
 #ifndef PROJEKT2_EVENTS_H
 #define PROJEKT2_EVENTS_H
 
+#include <algorithm>
 #include <vector>
+#include <string>
+#include <arpa/inet.h>
+
+#include "consts.h"
+#include "utils.h"
+#include "game_memory.h"
+#include "wire_schema.h"
 
 
 class Event {
@@ -29,33 +37,154 @@ public:
 
     void add_player(const std::string& player_name) {
         player_names.push_back(player_name);
+        names_length += player_name.size() + 1;
     }
 
     uint32_t get_length() const {
-        uint32_t length = 0;
+        return WIRE_LENGTHS[event_type] + names_length;
+    }
+
+    /*
+     * Writes event in wire format (length, event fields, crc32) to buffer.
+     * Returns number of bytes written, equal to get_length() + 8.
+     */
+    uint32_t serialize(uint8_t* buffer) const {
+        /* Encoder of every schema, indexed by event_type */
+        static constexpr uint32_t (*ENCODERS[])(const Event&, uint8_t*) = {
+                encode_new_game, encode_pixel, encode_player_eliminated, encode_game_over};
+        return finish_wire_record(buffer, ENCODERS[event_type](*this, buffer));
+    }
+
+private:
+    uint32_t names_length{}; // With '\0' after every name
+
+    /* Write record up to crc32, return its length */
+    static uint32_t encode_new_game(const Event& event, uint8_t* buffer) {
+        uint32_t pos = NewGameWire::encode(buffer, event.event_no, event.names_length,
+                                           event.x, event.y);
+        for (const auto& name : event.player_names) {
+            memcpy(buffer + pos, name.data(), name.size());
+            pos += name.size();
+            buffer[pos++] = '\0';
+        }
+        return pos;
+    }
+
+    static uint32_t encode_pixel(const Event& event, uint8_t* buffer) {
+        return PixelWire::encode(buffer, event.event_no, 0, event.player_number,
+                                 event.x, event.y);
+    }
+
+    static uint32_t encode_player_eliminated(const Event& event, uint8_t* buffer) {
+        return PlayerEliminatedWire::encode(buffer, event.event_no, 0, event.player_number);
+    }
+
+    static uint32_t encode_game_over(const Event& event, uint8_t* buffer) {
+        return GameOverWire::encode(buffer, event.event_no, 0);
+    }
+
+};
+
+/* Event log of a game, long ones are on huge pages */
+using GameEvents = std::vector<Event, GameAllocator<Event>>;
+
+/* Event log access used by ServerCommunicator, see also GameRecording */
+template<typename Allocator>
+uint32_t get_record_length(const std::vector<Event, Allocator>& events, uint32_t event_no) {
+    return events[event_no].get_length() + 8;
+}
+
+template<typename Allocator>
+uint32_t serialize_record(const std::vector<Event, Allocator>& events, uint32_t event_no,
+                          uint8_t* buffer) {
+    return events[event_no].serialize(buffer);
+}
+
+/*
+ * Reverse of Event::serialize, record has to be already checked to fit in
+ * memory and have proper crc32. Returns false if event can't be rebuilt.
+ */
+template<typename Allocator>
+bool append_event_from_record(std::vector<Event, Allocator>& events, const uint8_t* record) {
+    uint32_t event_len = load_wire<uint32_t>(record);
+    uint32_t event_no = load_wire<uint32_t>(record + 4);
+    uint8_t event_type = record[8];
+    if (event_type > GAME_OVER || event_len < WIRE_LENGTHS[event_type])
+        return false; // Unknown or truncated event
+
+    switch (event_type) {
+        case NEW_GAME: {
+            auto [maxx, maxy] = NewGameWire::decode(record);
+            events.emplace_back(event_no, maxx, maxy);
+            const char* names = (const char*) record + NewGameWire::fields_end;
+            const char* names_end = (const char*) record + 4 + event_len;
+            for (const char* name_end; (name_end = std::find(names, names_end, '\0')) != names_end;
+                 names = name_end + 1)
+                events.back().add_player(std::string(names, name_end)); // Every name ends with '\0'
+            return true;
+        }
+        case PIXEL: {
+            auto [player_number, x, y] = PixelWire::decode(record);
+            events.emplace_back(event_no, player_number, x, y);
+            return true;
+        }
+        case PLAYER_ELIMINATED:
+            events.emplace_back(event_no, std::get<0>(PlayerEliminatedWire::decode(record)));
+            return true;
+        default:
+            events.emplace_back(event_no);
+            return true;
+    }
+}
+
+/* Fields of the last record decoded by client, names only of NEW_GAME */
+class DecodedEvent {
+
+public:
+    uint8_t event_type{};
+    uint32_t event_no{};
+    uint32_t x{}, y{};
+    std::vector<std::string> names;
+    uint8_t player_number{};
+    bool crc32_valid{};
+
+    /* Decodes record at parsed_len of datagram of length len, returns position of the next one */
+    uint32_t decode(const uint8_t* datagram, uint32_t parsed_len, ssize_t len) {
+        const uint8_t* record = datagram + parsed_len;
+        uint32_t event_len = parsed_len + 4 <= len ? load_wire<uint32_t>(record) : 0;
+        if (event_len < GameOverWire::length || (int64_t) event_len + 8 > len - parsed_len) {
+            crc32_valid = false; // Event doesn't fit in datagram
+            return len;
+        }
+        event_no = load_wire<uint32_t>(record + 4);
+        event_type = record[8];
+        if (event_type <= GAME_OVER && event_len < WIRE_LENGTHS[event_type]) {
+            crc32_valid = false; // Fields of known event don't fit in it
+            return len;
+        }
         switch (event_type) {
-            case NEW_GAME:
-                length = 13; // 4 + 1 + 4 + 4
+            case NEW_GAME: {
+                std::tie(x, y) = NewGameWire::decode(record);
+                names.clear();
+                const char* names_begin = (const char*) record + NewGameWire::fields_end;
+                const char* names_end = (const char*) record + 4 + event_len;
+                for (const char* name_end; (name_end = std::find(names_begin, names_end, '\0')) != names_end;
+                     names_begin = name_end + 1)
+                    names.emplace_back(names_begin, name_end); // Every name ends with '\0'
                 break;
+            }
             case PIXEL:
-                length = 14; // 4 + 1 + 1 + 4 + 4
+                std::tie(player_number, x, y) = PixelWire::decode(record);
                 break;
             case PLAYER_ELIMINATED:
-                length = 6; // 4 + 1 + 1
+                std::tie(player_number) = PlayerEliminatedWire::decode(record);
                 break;
-            case GAME_OVER:
-                length = 5; // 4 + 1
-                break;
-        }
-        if (event_type == NEW_GAME) {
-            for (const std::string& player_name : player_names)
-                length += (player_name.size() + 1);
         }
-
-        return length;
+        crc32_valid = load_wire<uint32_t>(record + 4 + event_len) ==
+                      generate_crc32(record, event_len + 4);
+        return parsed_len + event_len + 8;
     }
 
 };
 
-
 #endif //PROJEKT2_EVENTS_H
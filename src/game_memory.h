@@ -0,0 +1,178 @@
+#ifndef PROJEKT2_GAME_MEMORY_H
+#define PROJEKT2_GAME_MEMORY_H
+
+#include <sys/mman.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <utility>
+#include <vector>
+
+/*
+ * Memory of grids and event logs. Blocks of at least HUGE_PAGE_SIZE are
+ * mapped separately and backed by explicit huge pages when some are reserved
+ * (vm.nr_hugepages), otherwise by transparent huge pages. Smaller blocks come
+ * from operator new. Pages of big blocks can be moved to NUMA node of the
+ * thread running the game, on single node machines this does nothing.
+ */
+
+const size_t HUGE_PAGE_SIZE = 2 << 20;
+
+/* Node of the calling thread, 0 when unknown */
+uint32_t get_current_node() {
+    unsigned cpu, node;
+    if (getcpu(&cpu, &node) != 0)
+        return 0;
+    return node;
+}
+
+bool is_huge_block(size_t size) {
+    return size >= HUGE_PAGE_SIZE;
+}
+
+size_t get_huge_block_size(size_t size) {
+    return (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+}
+
+/* Memory is zeroed only when it is a huge block */
+void* allocate_game_memory(size_t size) {
+    if (!is_huge_block(size))
+        return ::operator new(size);
+    size = get_huge_block_size(size);
+
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (memory != MAP_FAILED)
+        return memory;
+
+    /* No reserved huge pages, align mapping so it can use transparent ones */
+    auto* mapping = (uint8_t*) mmap(nullptr, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED)
+        throw std::bad_alloc();
+    auto* aligned = (uint8_t*) get_huge_block_size((uintptr_t) mapping);
+    if (aligned != mapping)
+        munmap(mapping, aligned - mapping);
+    munmap(aligned + size, mapping + HUGE_PAGE_SIZE - aligned);
+    madvise(aligned, size, MADV_HUGEPAGE);
+    return aligned;
+}
+
+void free_game_memory(void* memory, size_t size) {
+    if (memory == nullptr)
+        return;
+    if (!is_huge_block(size))
+        ::operator delete(memory);
+    else
+        munmap(memory, get_huge_block_size(size));
+}
+
+/* Moves pages of huge block, also ones touched later, to the node */
+void move_game_memory(void* memory, size_t size, uint32_t node) {
+    if (!is_huge_block(size) || node >= 64)
+        return;
+    uint64_t nodes = 1ULL << node;
+    syscall(SYS_mbind, memory, get_huge_block_size(size), MPOL_PREFERRED,
+            &nodes, 64, MPOL_MF_MOVE);
+}
+
+/* Allocator of event logs */
+template<typename T>
+class GameAllocator {
+
+public:
+    using value_type = T;
+
+    GameAllocator() = default;
+
+    template<typename U>
+    GameAllocator(const GameAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        return (T*) allocate_game_memory(n * sizeof(T));
+    }
+
+    void deallocate(T* memory, size_t n) {
+        free_game_memory(memory, n * sizeof(T));
+    }
+
+    template<typename U>
+    bool operator==(const GameAllocator<U>&) const {
+        return true;
+    }
+
+    template<typename U>
+    bool operator!=(const GameAllocator<U>&) const {
+        return false;
+    }
+
+};
+
+/* Moves storage of vector from GameAllocator, which starts its block, to the node */
+template<typename T>
+void move_game_vector(std::vector<T, GameAllocator<T>>& vector, uint32_t node) {
+    move_game_memory(vector.data(), vector.capacity() * sizeof(T), node);
+}
+
+/* Grid of the board, column after column, placed on node of its game */
+class GamePixels {
+
+    bool* pixels = nullptr;
+    size_t size{};
+    uint32_t node{};
+
+public:
+    GamePixels() = default;
+
+    GamePixels(const GamePixels&) = delete;
+    GamePixels& operator=(const GamePixels&) = delete;
+
+    GamePixels(GamePixels&& other) noexcept
+                : pixels(other.pixels), size(other.size), node(other.node) {
+        other.pixels = nullptr;
+        other.size = 0;
+    }
+
+    GamePixels& operator=(GamePixels&& other) noexcept {
+        std::swap(pixels, other.pixels);
+        std::swap(size, other.size);
+        std::swap(node, other.node);
+        return *this;
+    }
+
+    ~GamePixels() {
+        free_game_memory(pixels, size);
+    }
+
+    /* Contents are undefined after resizing */
+    void resize(size_t new_size) {
+        if (new_size == size)
+            return;
+        free_game_memory(pixels, size);
+        pixels = nullptr; // In case of failed allocation
+        size = 0;
+        pixels = (bool*) allocate_game_memory(new_size);
+        size = new_size;
+        node = get_current_node();
+    }
+
+    /* Called by thread running the game, cheap when node didn't change */
+    void place_on_current_node() {
+        uint32_t current_node = get_current_node();
+        if (current_node == node)
+            return;
+        move_game_memory(pixels, size, current_node);
+        node = current_node;
+    }
+
+    bool* get() const {
+        return pixels;
+    }
+
+};
+
+#endif //PROJEKT2_GAME_MEMORY_H
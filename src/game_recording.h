@@ -0,0 +1,236 @@
+#ifndef PROJEKT2_GAME_RECORDING_H
+#define PROJEKT2_GAME_RECORDING_H
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "consts.h"
+#include "events.h"
+
+/*
+ * Recording file layout, one file per game:
+ *   RecordingHeader
+ *   events, each exactly as sent in datagrams (length, fields, crc32)
+ *   RecordingIndexEntry for every event
+ *   RecordingTrailer
+ * Integers of header, index and trailer are in host byte order, so file
+ * can be used through mmap without any parsing.
+ */
+const uint32_t RECORDING_MAGIC = 0x43525753; // "SWRC"
+const uint32_t RECORDING_INDEX_MAGIC = 0x49525753; // "SWRI"
+const uint32_t RECORDING_VERSION = 1;
+
+struct RecordingHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t game_id;
+    uint32_t rounds_per_sec;
+};
+
+struct RecordingIndexEntry {
+    uint64_t offset; // Of event record from the beginning of file
+    uint32_t round; // In which event was generated, 0 for start of game
+    uint32_t length; // Of event record
+};
+
+struct RecordingTrailer {
+    uint64_t index_offset;
+    uint32_t events_number;
+    uint32_t magic;
+};
+
+/* Writes games to recording files while they are played */
+class GameRecorder {
+
+    const std::string directory;
+    int fd = -1;
+    uint64_t file_pos{};
+    uint32_t recorded_events{};
+    std::vector<RecordingIndexEntry> index;
+    std::vector<uint8_t> buffer;
+
+public:
+
+    explicit GameRecorder(std::string directory): directory(std::move(directory)) {}
+
+    bool is_enabled() const {
+        return !directory.empty();
+    }
+
+    void start_game(uint32_t game_id, uint16_t rounds_per_sec) {
+        if (!is_enabled())
+            return;
+        if (fd >= 0)
+            finish_game(); // Previous game wasn't finished properly
+
+        std::string path = directory + "/" + std::to_string(game_id) + ".swr";
+        fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            // Just report error, game can be played without recording
+            std::cerr << "Opening recording " << path << " failed!" << std::endl;
+            return;
+        }
+
+        RecordingHeader header{RECORDING_MAGIC, RECORDING_VERSION, game_id, rounds_per_sec};
+        file_pos = 0;
+        recorded_events = 0;
+        index.clear();
+        write_to_file((const uint8_t*) &header, sizeof(header));
+    }
+
+    /* Appends every event which wasn't recorded yet */
+    template<typename Allocator>
+    void record(const std::vector<Event, Allocator>& events, uint32_t round) {
+        if (fd < 0)
+            return;
+
+        buffer.clear();
+        for (; recorded_events < events.size(); ++recorded_events) {
+            uint32_t length = get_record_length(events, recorded_events);
+            index.push_back({file_pos + buffer.size(), round, length});
+            buffer.resize(buffer.size() + length);
+            serialize_record(events, recorded_events, buffer.data() + buffer.size() - length);
+        }
+        write_to_file(buffer.data(), buffer.size());
+    }
+
+    /* Writes index, recording can't be extended afterwards */
+    void finish_game() {
+        if (fd < 0)
+            return;
+
+        RecordingTrailer trailer{file_pos, (uint32_t) index.size(), RECORDING_INDEX_MAGIC};
+        write_to_file((const uint8_t*) index.data(), index.size() * sizeof(index[0]));
+        write_to_file((const uint8_t*) &trailer, sizeof(trailer));
+        close(fd);
+        fd = -1;
+    }
+
+private:
+    void write_to_file(const uint8_t* data, size_t size) {
+        while (size > 0) {
+            ssize_t len = write(fd, data, size);
+            if (len < 0) {
+                std::cerr << "Writing recording failed!" << std::endl;
+                close(fd);
+                fd = -1;
+                return;
+            }
+            data += len;
+            size -= len;
+            file_pos += len;
+        }
+    }
+
+};
+
+/*
+ * Recording mapped to memory. Can be used as event log by ServerCommunicator,
+ * only first visible_events are seen by clients.
+ */
+class GameRecording {
+
+    const uint8_t* data = nullptr;
+    size_t data_size{};
+    const RecordingIndexEntry* index = nullptr;
+
+public:
+    uint32_t game_id{};
+    uint16_t rounds_per_sec{};
+    uint32_t events_number{};
+    uint32_t visible_events{};
+
+    explicit GameRecording(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            report_fail("Opening recording failed!");
+        struct stat file_stat{};
+        if (fstat(fd, &file_stat) < 0)
+            report_fail("Reading recording size failed!");
+        data_size = file_stat.st_size;
+        if (data_size < sizeof(RecordingHeader) + sizeof(RecordingTrailer))
+            report_fail("Recording is too short!");
+
+        void* ptr = mmap(nullptr, data_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (ptr == MAP_FAILED)
+            report_fail("Mapping recording failed!");
+        data = (const uint8_t*) ptr;
+
+        auto header = (const RecordingHeader*) data;
+        auto trailer = (const RecordingTrailer*) (data + data_size - sizeof(RecordingTrailer));
+        if (header->magic != RECORDING_MAGIC || header->version != RECORDING_VERSION)
+            report_fail("Recording format unknown!");
+        if (trailer->magic != RECORDING_INDEX_MAGIC)
+            report_fail("Recording is not finished!");
+        if (header->rounds_per_sec == 0)
+            report_fail("Recording header corrupted!");
+        if (trailer->index_offset < sizeof(RecordingHeader) ||
+            trailer->index_offset > data_size - sizeof(RecordingTrailer) ||
+            trailer->index_offset + (uint64_t) trailer->events_number * sizeof(RecordingIndexEntry) +
+            sizeof(RecordingTrailer) != data_size)
+            report_fail("Recording index corrupted!");
+
+        game_id = header->game_id;
+        rounds_per_sec = header->rounds_per_sec;
+        events_number = trailer->events_number;
+        index = (const RecordingIndexEntry*) (data + trailer->index_offset);
+
+        /* Every record has to lie between header and index and fit in a datagram */
+        for (uint32_t event_no = 0; event_no < events_number; ++event_no) {
+            const RecordingIndexEntry& entry = index[event_no];
+            if (entry.offset < sizeof(RecordingHeader) || entry.length < GameOverWire::length + 8 ||
+                entry.length > MAX_SERVER_DATAGRAM_SIZE - 4 || entry.length > trailer->index_offset ||
+                entry.offset > trailer->index_offset - entry.length)
+                report_fail("Recording index corrupted!");
+        }
+    }
+
+    GameRecording(const GameRecording&) = delete;
+    GameRecording& operator=(const GameRecording&) = delete;
+
+    ~GameRecording() {
+        munmap((void*) data, data_size);
+    }
+
+    uint32_t size() const {
+        return visible_events;
+    }
+
+    uint32_t get_round(uint32_t event_no) const {
+        return index[event_no].round;
+    }
+
+    uint32_t get_length(uint32_t event_no) const {
+        return index[event_no].length;
+    }
+
+    const uint8_t* get_record(uint32_t event_no) const {
+        return data + index[event_no].offset;
+    }
+
+private:
+    static void report_fail(const char* message) {
+        std::cerr << message << std::endl;
+        exit(1);
+    }
+
+};
+
+uint32_t get_record_length(const GameRecording& recording, uint32_t event_no) {
+    return recording.get_length(event_no);
+}
+
+uint32_t serialize_record(const GameRecording& recording, uint32_t event_no,
+                          uint8_t* buffer) {
+    memcpy(buffer, recording.get_record(event_no), recording.get_length(event_no));
+    return recording.get_length(event_no);
+}
+
+#endif //PROJEKT2_GAME_RECORDING_H
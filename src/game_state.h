@@ -6,12 +6,37 @@
 #include <queue>
 #include <algorithm>
 #include <cmath>
+#include <memory>
+#include <string>
 
+#include "consts.h"
 #include "utils.h"
-#include "server_communicator.h"
+#include "events.h"
+#include "server_handoff.h"
+#include "game_memory.h"
 
+/* Board size taken at start of every game instead of compile time */
+const uint32_t DYNAMIC_BOARD = 0;
+
+/*
+ * Rules of the game, independent of networking: worms are steered with array
+ * of turn directions indexed by player number and results are appended to
+ * events. With WIDTH x HEIGHT board known at compile time grid is sized to
+ * the board once and bounds checks fold to constants. GameState<> takes
+ * board size from start_game and allocates grid for it. Grid and event log
+ * use game memory, big ones are on huge pages and follow the thread running
+ * the game to its NUMA node.
+ */
+template<uint32_t WIDTH = DYNAMIC_BOARD, uint32_t HEIGHT = DYNAMIC_BOARD>
 class GameState {
 
+    static_assert((WIDTH == DYNAMIC_BOARD) == (HEIGHT == DYNAMIC_BOARD),
+                  "Both board dimensions have to be fixed or dynamic");
+    static_assert(WIDTH <= MAX_SCREEN_WIDTH && HEIGHT <= MAX_SCREEN_HEIGHT,
+                  "Board too big");
+
+    static constexpr bool IS_DYNAMIC = WIDTH == DYNAMIC_BOARD;
+
 private:
     class WormData {
 
@@ -30,64 +55,71 @@ private:
     };
 
     std::vector<WormData> worm_data;
-    bool pixels[MAX_SCREEN_WIDTH][MAX_SCREEN_HEIGHT]{};
+    GamePixels pixels;
     uint16_t turning_speed{};
-    uint32_t maxx{}, maxy{};
+    uint32_t maxx{}, maxy{}; // 0 before first game, use get_maxx and get_maxy in game
     uint8_t alive_worms{};
     uint32_t rand;
+    uint32_t events_node{}; // Node of event log kept from previous games
 
 public:
-    std::vector<Event> events;
+    GameEvents events;
     uint32_t game_id{};
 
-    explicit GameState(uint32_t seed): rand(seed) {};
+    explicit GameState(uint32_t seed): rand(seed) {
+        if constexpr (!IS_DYNAMIC)
+            pixels.resize((size_t) WIDTH * HEIGHT);
+    };
+
+    /* Whether games on board of given size can be played */
+    static bool is_board_supported(uint32_t width, uint32_t height) {
+        return IS_DYNAMIC || (width == WIDTH && height == HEIGHT);
+    }
 
     /*
-     * Starts new game. Returns false if game has ended during
+     * Starts new game for players sorted alphabetically, worm of every player
+     * gets its index as player number. Returns false if game has ended during
      * worm spawning and true if game is still not ended.
      */
-    bool start_game(ServerCommunicator& communicator, uint32_t maxx_arg,
+    bool start_game(const std::vector<std::string>& players_names, uint32_t maxx_arg,
                     uint32_t maxy_arg, uint16_t turning_speed_arg) {
         /* Clear previous game data */
         worm_data.clear();
         events.clear();
-        for (int x = 0; x < maxx_arg; ++x)
-            for (int y = 0; y < maxy_arg; ++y)
-                pixels[x][y] = true;
 
         game_id = next_rand();
         turning_speed = turning_speed_arg;
+        alive_worms = 0;
+        if constexpr (IS_DYNAMIC)
+            pixels.resize((size_t) maxx_arg * maxy_arg);
+        pixels.place_on_current_node();
+        place_events_on_current_node();
         maxx = maxx_arg;
         maxy = maxy_arg;
-        alive_worms = 0;
+        for (uint32_t x = 0; x < get_maxx(); ++x)
+            std::fill(get_column(x), get_column(x) + get_maxy(), true);
 
         /* Generate new game event */
-        events.emplace_back(events.size(), maxx, maxy);
-        for (const auto& client : communicator.client_data)
-            if (!client.player_name.empty())
-                events.back().add_player(client.player_name);
-
-        /* Initialize worms for clients with non-empty names from communicator
-         * Clients are already sorted alphabetically so their worms would be too */
-        sort(communicator.client_data.begin(), communicator.client_data.end());
-        for (auto& client : communicator.client_data) {
-            if (client.player_name.empty())
-                continue; // This client is an observer
-
-            worm_data.emplace_back((next_rand() % maxx) + 0.5, (next_rand() % maxy) + 0.5,
-                                   next_rand() % 360,worm_data.size());
+        events.emplace_back(events.size(), get_maxx(), get_maxy());
+        for (const auto& player_name : players_names)
+            events.back().add_player(player_name);
+
+        /* Initialize worms in order of players */
+        for (uint8_t player_number = 0; player_number < players_names.size(); ++player_number) {
+            worm_data.emplace_back((next_rand() % get_maxx()) + 0.5,
+                                   (next_rand() % get_maxy()) + 0.5,
+                                   next_rand() % 360, player_number);
             alive_worms++;
-            client.player_number = worm_data.back().player_number;
 
-            if (pixels[(uint32_t)worm_data.back().x_pos]
-                      [(uint32_t)worm_data.back().y_pos]) {
+            bool& pixel = get_column((uint32_t)worm_data.back().x_pos)
+                                    [(uint32_t)worm_data.back().y_pos];
+            if (pixel) {
                 /* Pixel was free, can be eaten */
                 events.emplace_back(events.size(),
                                     worm_data.back().player_number,
                                     (uint32_t)worm_data.back().x_pos,
                                     (uint32_t)worm_data.back().y_pos);
-                pixels[(uint32_t)worm_data.back().x_pos]
-                      [(uint32_t)worm_data.back().y_pos] = false;
+                pixel = false;
             }
             else {
                 /* Pixel already eaten, player eliminated */
@@ -99,34 +131,29 @@ public:
         if (alive_worms == 1) {
             /* Only one worm survived */
             events.emplace_back(events.size());
-            communicator.send_events_to_everyone(events, 0, game_id);
             return false;
         }
-        communicator.send_events_to_everyone(events, 0, game_id);
         return true;
     }
 
     /*
-     * Finishes round. Returns true if game is still rolling and false if
-     * GAME_OVER event was generated.
+     * Finishes round, turn_directions holds direction for every player number,
+     * NO_CHANGES keeps previous one. Returns true if game is still rolling and
+     * false if GAME_OVER event was generated.
      */
-    bool finish_round(ServerCommunicator& communicator) {
-        uint32_t first_event_no = events.size();
-
-        for (auto worm : worm_data) {
+    bool finish_round(const uint8_t* turn_directions) {
+        for (auto& worm : worm_data) {
             if (!worm.alive)
                 continue;
             if (alive_worms == 1) {
                 /* This worm is the last one standing */
                 events.emplace_back(events.size());
-                communicator.send_events_to_everyone(events, first_event_no, game_id);
                 return false;
             }
 
             /* Update turn_direction only when client is still connected */
-            if (communicator.get_new_turn_direction(worm.player_number) != NO_CHANGES)
-                worm.turn_direction = communicator.get_new_turn_direction(
-                                            worm.player_number);
+            if (turn_directions[worm.player_number] != NO_CHANGES)
+                worm.turn_direction = turn_directions[worm.player_number];
 
             if (worm.turn_direction == LEFT)
                 worm.azimuth = (worm.azimuth + turning_speed) % 360;
@@ -140,9 +167,9 @@ public:
             if ((uint32_t)worm.x_pos != (uint32_t)old_x_pos ||
                 (uint32_t)worm.y_pos != (uint32_t)old_y_pos) {
 
-                if (worm.x_pos < 0 || worm.x_pos > maxx - 1 ||
-                    worm.y_pos < 0 || worm.y_pos > maxy - 1 ||
-                    !pixels[(uint32_t)worm.x_pos][(uint32_t)worm.y_pos]) {
+                if (worm.x_pos < 0 || worm.x_pos > get_maxx() - 1 ||
+                    worm.y_pos < 0 || worm.y_pos > get_maxy() - 1 ||
+                    !get_column((uint32_t)worm.x_pos)[(uint32_t)worm.y_pos]) {
 
                     /* Pixel already eaten or out of screen, player eliminated */
                     events.emplace_back(events.size(), worm.player_number);
@@ -153,16 +180,113 @@ public:
                     /* Pixel was free, can be eaten */
                     events.emplace_back(events.size(), worm.player_number,
                                         (uint32_t)worm.x_pos, (uint32_t)worm.y_pos);
-                    pixels[(uint32_t)worm.x_pos][(uint32_t)worm.y_pos] = false;
+                    get_column((uint32_t)worm.x_pos)[(uint32_t)worm.y_pos] = false;
                 }
             }
 
         }
-        communicator.send_events_to_everyone(events, first_event_no, game_id);
         return true; // Game still rolling
     }
 
+    void save(HandoffWriter& writer) const {
+        writer.put(game_id);
+        writer.put(rand);
+        writer.put(turning_speed);
+        writer.put(maxx);
+        writer.put(maxy);
+        writer.put(alive_worms);
+
+        writer.put<uint32_t>(worm_data.size());
+        for (const auto& worm : worm_data) {
+            writer.put(worm.x_pos);
+            writer.put(worm.y_pos);
+            writer.put(worm.azimuth);
+            writer.put(worm.player_number);
+            writer.put(worm.alive);
+            writer.put(worm.turn_direction);
+        }
+
+        for (uint32_t x = 0; x < maxx; ++x)
+            writer.put_bytes(get_column(x), maxy * sizeof(bool));
+
+        uint8_t record[MAX_SERVER_DATAGRAM_SIZE];
+        writer.put<uint32_t>(events.size());
+        for (const auto& event : events)
+            writer.put_bytes(record, event.serialize(record));
+    }
+
+    void load(HandoffReader& reader) {
+        game_id = reader.get<uint32_t>();
+        rand = reader.get<uint32_t>();
+        turning_speed = reader.get<uint16_t>();
+        maxx = reader.get<uint32_t>();
+        maxy = reader.get<uint32_t>();
+        if (maxx > MAX_SCREEN_WIDTH || maxy > MAX_SCREEN_HEIGHT ||
+            (maxx != 0 && !is_board_supported(maxx, maxy))) {
+            std::cerr << "Handed off board size not supported!" << std::endl;
+            exit(1);
+        }
+        alive_worms = reader.get<uint8_t>();
+
+        worm_data.clear();
+        for (auto worms = reader.get<uint32_t>(); worms > 0; --worms) {
+            auto x_pos = reader.get<double>();
+            auto y_pos = reader.get<double>();
+            auto azimuth = reader.get<uint16_t>();
+            worm_data.emplace_back(x_pos, y_pos, azimuth, reader.get<uint8_t>());
+            worm_data.back().alive = reader.get<bool>();
+            worm_data.back().turn_direction = reader.get<uint8_t>();
+        }
+
+        if constexpr (IS_DYNAMIC)
+            pixels.resize((size_t) maxx * maxy);
+        for (uint32_t x = 0; x < maxx; ++x)
+            memcpy(get_column(x), reader.get_bytes(maxy * sizeof(bool)), maxy * sizeof(bool));
+
+        events.clear();
+        for (auto events_number = reader.get<uint32_t>(); events_number > 0; --events_number) {
+            const uint8_t* record = reader.get_bytes(4);
+            reader.get_bytes(load_wire<uint32_t>(record) + 4);
+            append_event_from_record(events, record);
+        }
+    }
+
 private:
+    uint32_t get_maxx() const {
+        if constexpr (IS_DYNAMIC)
+            return maxx;
+        else
+            return WIDTH;
+    }
+
+    uint32_t get_maxy() const {
+        if constexpr (IS_DYNAMIC)
+            return maxy;
+        else
+            return HEIGHT;
+    }
+
+    bool* get_column(uint32_t x) {
+        return pixels.get() + (size_t) x * get_maxy();
+    }
+
+    const bool* get_column(uint32_t x) const {
+        return const_cast<GameState*>(this)->get_column(x);
+    }
+
+    /*
+     * Event log keeps its capacity between games, so it stays where the first
+     * ones touched it. Blocks allocated later are touched first by the thread
+     * running the game and don't have to be moved.
+     */
+    void place_events_on_current_node() {
+        uint32_t current_node = get_current_node();
+        if (current_node == events_node)
+            return;
+        move_game_vector(events, current_node);
+        events_node = current_node;
+    }
+
     uint32_t next_rand() {
         uint32_t res = rand;
         rand = ((uint64_t)rand * 279410273) % 4294967291;
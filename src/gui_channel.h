@@ -0,0 +1,268 @@
+#ifndef PROJEKT2_GUI_CHANNEL_H
+#define PROJEKT2_GUI_CHANNEL_H
+
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "consts.h"
+
+/*
+ * Single producer single consumer ring of variable length records placed in
+ * shared memory. Every record is prefixed with its uint16_t length and
+ * aligned to 4 bytes. Record which doesn't fit before the end of buffer is
+ * preceded by padding marker and placed at the beginning.
+ */
+class ShmRing {
+
+public:
+    class Header {
+
+    public:
+        alignas(64) std::atomic<uint32_t> head; // Consumer position
+        alignas(64) std::atomic<uint32_t> tail; // Producer position
+        alignas(64) std::atomic<uint32_t> consumer_waiting;
+
+    };
+
+private:
+    static const uint16_t PADDING = 0xFFFF;
+
+    Header* header = nullptr;
+    uint8_t* data = nullptr;
+    uint32_t capacity{}; // Power of 2
+
+public:
+    ShmRing() = default;
+
+    ShmRing(uint8_t* memory, uint32_t capacity)
+            : header((Header*) memory), data(memory + sizeof(Header)), capacity(capacity) {}
+
+    static uint32_t memory_size(uint32_t capacity) {
+        return sizeof(Header) + capacity;
+    }
+
+    bool push(const uint8_t* record, uint16_t len) {
+        uint32_t tail = header->tail.load(std::memory_order_relaxed),
+                 head = header->head.load(std::memory_order_acquire);
+        uint32_t size = aligned_size(len),
+                 offset = tail & (capacity - 1),
+                 to_end = capacity - offset;
+        if (capacity - (tail - head) < (size <= to_end ? size : to_end + size))
+            return false; // Consumer is too slow
+
+        if (size > to_end) {
+            *(uint16_t*) (data + offset) = PADDING;
+            tail += to_end;
+            offset = 0;
+        }
+        *(uint16_t*) (data + offset) = len;
+        memcpy(data + offset + sizeof(uint16_t), record, len);
+        header->tail.store(tail + size, std::memory_order_release);
+        return true;
+    }
+
+    /* Record buffer has to hold MAX_GUI_RECORD_SIZE bytes */
+    bool pop(uint8_t* record, uint16_t& len) {
+        uint32_t head = header->head.load(std::memory_order_relaxed),
+                 tail = header->tail.load(std::memory_order_acquire);
+        if (head == tail)
+            return false;
+
+        uint32_t offset = head & (capacity - 1);
+        if (*(uint16_t*) (data + offset) == PADDING) {
+            head += capacity - offset;
+            offset = 0;
+        }
+        len = *(uint16_t*) (data + offset);
+        if (len > MAX_GUI_RECORD_SIZE || offset + aligned_size(len) > capacity)
+            return false; // Broken by the other side of shared memory
+        memcpy(record, data + offset + sizeof(uint16_t), len);
+        header->head.store(head + aligned_size(len), std::memory_order_release);
+        return true;
+    }
+
+    bool is_empty() const {
+        return header->head.load(std::memory_order_acquire) ==
+               header->tail.load(std::memory_order_acquire);
+    }
+
+    Header* get_header() const {
+        return header;
+    }
+
+private:
+    static uint32_t aligned_size(uint16_t len) {
+        return (sizeof(uint16_t) + len + 3) & ~3U;
+    }
+
+};
+
+/*
+ * Alternative to TCP text protocol for user interface on the same host.
+ * User interface creates shared memory with two rings (events for GUI and key
+ * presses from GUI) and eventfd for each of them, and passes them with
+ * SCM_RIGHTS to client connecting to its Unix socket. Eventfd is written only
+ * when consumer of the ring announced it's going to sleep.
+ */
+class GuiChannel {
+
+    int memfd = -1;
+    int events_fd = -1, keys_fd = -1;
+    uint8_t* memory = nullptr;
+    ShmRing events_ring, keys_ring;
+
+public:
+
+    bool is_active() const {
+        return memory != nullptr;
+    }
+
+    /* User interface side, creates shared memory and eventfds */
+    void create() {
+        memfd = memfd_create("screen-worms-gui", 0);
+        if (memfd < 0 || ftruncate(memfd, get_memory_size()) < 0)
+            report_fail("Creating gui memory failed!");
+        events_fd = eventfd(0, EFD_NONBLOCK);
+        keys_fd = eventfd(0, EFD_NONBLOCK);
+        if (events_fd < 0 || keys_fd < 0)
+            report_fail("Creating gui eventfd failed!");
+        map_memory();
+    }
+
+    /* User interface side, passes channel to connected client */
+    void send_to(int sock) const {
+        int fds[3] = {memfd, events_fd, keys_fd};
+        uint8_t ok = 1;
+        struct iovec iov{&ok, sizeof(ok)};
+        char control[CMSG_SPACE(sizeof(fds))]{};
+        struct msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+        if (sendmsg(sock, &msg, 0) != sizeof(ok))
+            report_fail("Passing gui channel failed!");
+    }
+
+    /* Client side, receives channel from user interface listening on path */
+    void connect_to(const std::string& path) {
+        int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path))
+            report_fail("Gui socket path too long!");
+        strcpy(address.sun_path, path.c_str());
+        if (connect(sock, (struct sockaddr*) &address, sizeof(address)) < 0)
+            report_fail("Gui server connection failed!");
+
+        int fds[3];
+        uint8_t ok;
+        struct iovec iov{&ok, sizeof(ok)};
+        char control[CMSG_SPACE(sizeof(fds))]{};
+        struct msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(sock, &msg, 0) != sizeof(ok))
+            report_fail("Receiving gui channel failed!");
+        close(sock);
+
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        if (cmsg == nullptr || cmsg->cmsg_type != SCM_RIGHTS ||
+            cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+            report_fail("Gui channel descriptors missing!");
+        memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+        memfd = fds[0];
+        events_fd = fds[1];
+        keys_fd = fds[2];
+        map_memory();
+    }
+
+    /* Client side */
+    bool push_event(const uint8_t* record, uint16_t len) {
+        return push(events_ring, events_fd, record, len);
+    }
+
+    bool pop_key(uint8_t& key) {
+        uint8_t record[MAX_GUI_RECORD_SIZE];
+        uint16_t len;
+        if (!keys_ring.pop(record, len) || len != 1)
+            return false;
+        key = record[0];
+        return true;
+    }
+
+    /* User interface side */
+    bool push_key(uint8_t key) {
+        return push(keys_ring, keys_fd, &key, 1);
+    }
+
+    bool pop_event(uint8_t* record, uint16_t& len) {
+        return events_ring.pop(record, len);
+    }
+
+    /* Sleeps until client pushes an event or another fd becomes readable */
+    void wait_for_events(int other_fd) {
+        ShmRing::Header* header = events_ring.get_header();
+        header->consumer_waiting.store(1, std::memory_order_seq_cst);
+        if (events_ring.is_empty()) {
+            struct pollfd fds[2] = {{events_fd, POLLIN, 0}, {other_fd, POLLIN, 0}};
+            poll(fds, other_fd >= 0 ? 2 : 1, -1);
+            uint64_t counter;
+            if (read(events_fd, &counter, sizeof(counter)) < 0)
+                counter = 0; // Woken up by other fd
+        }
+        header->consumer_waiting.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    static uint32_t get_memory_size() {
+        return 2 * ShmRing::memory_size(GUI_RING_CAPACITY);
+    }
+
+    void map_memory() {
+        void* ptr = mmap(nullptr, get_memory_size(), PROT_READ | PROT_WRITE,
+                         MAP_SHARED, memfd, 0);
+        if (ptr == MAP_FAILED)
+            report_fail("Mapping gui memory failed!");
+        memory = (uint8_t*) ptr;
+        events_ring = ShmRing(memory, GUI_RING_CAPACITY);
+        keys_ring = ShmRing(memory + ShmRing::memory_size(GUI_RING_CAPACITY),
+                            GUI_RING_CAPACITY);
+    }
+
+    static bool push(ShmRing& ring, int fd, const uint8_t* record, uint16_t len) {
+        if (!ring.push(record, len))
+            return false;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (ring.get_header()->consumer_waiting.exchange(0)) {
+            uint64_t one = 1;
+            if (write(fd, &one, sizeof(one)) != sizeof(one))
+                return false;
+        }
+        return true;
+    }
+
+    static void report_fail(const char* message) {
+        std::cerr << message << std::endl;
+        exit(1);
+    }
+
+};
+
+#endif //PROJEKT2_GUI_CHANNEL_H
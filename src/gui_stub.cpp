@@ -0,0 +1,122 @@
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "consts.h"
+#include "gui_channel.h"
+
+/*
+ * Reference user interface for shared memory channel. Prints every event in
+ * the same form as text protocol of TCP user interface and passes key lines
+ * (LEFT_KEY_DOWN etc.) read from standard input to the client.
+ */
+
+void report_fail(const char* message) {
+    std::cerr << message << std::endl;
+    exit(1);
+}
+
+void wait_for_client(GuiChannel& channel, const std::string& path) {
+    struct sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+        report_fail("Socket path too long!");
+    strcpy(address.sun_path, path.c_str());
+
+    unlink(path.c_str());
+    int listen_sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (bind(listen_sock, (struct sockaddr*) &address, sizeof(address)) < 0 ||
+        listen(listen_sock, 1) < 0)
+        report_fail("Listening for client failed!");
+
+    int sock = accept(listen_sock, nullptr, nullptr);
+    if (sock < 0)
+        report_fail("Accepting client failed!");
+    channel.send_to(sock);
+    close(sock);
+    close(listen_sock);
+    unlink(path.c_str());
+}
+
+void print_event(const uint8_t* record, uint16_t len, std::vector<std::string>& names) {
+    uint32_t x, y;
+    switch (record[0]) {
+        case NEW_GAME:
+            memcpy(&x, record + 1, 4);
+            memcpy(&y, record + 5, 4);
+            names.clear();
+            std::cout << "NEW_GAME " << x << " " << y;
+            for (uint16_t pos = 9; pos < len; pos += names.back().size() + 1) {
+                names.emplace_back((const char*) record + pos);
+                std::cout << " " << names.back();
+            }
+            std::cout << "\n";
+            break;
+        case PIXEL:
+            memcpy(&x, record + 2, 4);
+            memcpy(&y, record + 6, 4);
+            if (record[1] < names.size())
+                std::cout << "PIXEL " << x << " " << y << " " << names[record[1]] << "\n";
+            break;
+        case PLAYER_ELIMINATED:
+            if (record[1] < names.size())
+                std::cout << "PLAYER_ELIMINATED " << names[record[1]] << "\n";
+            break;
+    }
+}
+
+void read_keys(GuiChannel& channel, int& input_fd, std::string& input) {
+    char buffer[256];
+    ssize_t len = read(input_fd, buffer, sizeof(buffer));
+    if (len <= 0) {
+        input_fd = -1; // Nothing more to send
+        return;
+    }
+    input.append(buffer, len);
+
+    size_t end;
+    while ((end = input.find('\n')) != std::string::npos) {
+        std::string line = input.substr(0, end);
+        input.erase(0, end + 1);
+        uint8_t key = line == "LEFT_KEY_DOWN" ? LEFT_KEY_DOWN :
+                      line == "LEFT_KEY_UP" ? LEFT_KEY_UP :
+                      line == "RIGHT_KEY_DOWN" ? RIGHT_KEY_DOWN :
+                      line == "RIGHT_KEY_UP" ? RIGHT_KEY_UP : NO_CHANGES;
+        if (key != NO_CHANGES && !channel.push_key(key))
+            report_fail("Client doesn't read keys!");
+    }
+}
+
+[[noreturn]] void run_gui(GuiChannel& channel) {
+    uint8_t record[MAX_GUI_RECORD_SIZE];
+    uint16_t len;
+    std::vector<std::string> names;
+    std::string input;
+    int input_fd = STDIN_FILENO;
+
+    while (true) {
+        while (channel.pop_event(record, len))
+            print_event(record, len, names);
+        std::cout.flush();
+
+        channel.wait_for_events(input_fd);
+        struct pollfd input_poll{input_fd, POLLIN, 0};
+        if (input_fd >= 0 && poll(&input_poll, 1, 0) > 0)
+            read_keys(channel, input_fd, input);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+        report_fail("Usage: screen-worms-gui-stub socket_path");
+
+    GuiChannel channel;
+    channel.create();
+    wait_for_client(channel, argv[1]);
+    run_gui(channel);
+}
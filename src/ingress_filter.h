@@ -0,0 +1,144 @@
+#ifndef PROJEKT2_INGRESS_FILTER_H
+#define PROJEKT2_INGRESS_FILTER_H
+
+#include <netinet/in.h>
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+#include "consts.h"
+
+/*
+ * Cheap checks of client datagrams made before they are decoded. Endpoints of
+ * registered clients get token bucket each, kept in fixed-size hash table with
+ * linear probing. Datagrams from other endpoints share budget per second,
+ * so flood of spoofed packets can't starve the game loop.
+ */
+class IngressFilter {
+
+    static const uint32_t TABLE_BITS = 15;
+    static const uint32_t TABLE_SIZE = 1 << TABLE_BITS;
+    static_assert(CLIENTS_MAX_NUMBER + MAX_OBSERVERS_NUMBER <= TABLE_SIZE / 2,
+                  "Every client has to get a bucket in half full table");
+    static const uint64_t EMPTY_KEY = 0;
+    static const uint64_t TOKEN_TIME = 1000000 / INGRESS_ENDPOINT_RATE;
+    static const uint64_t BUCKET_TIME = TOKEN_TIME * INGRESS_ENDPOINT_BURST;
+
+    class Bucket {
+
+    public:
+        uint64_t key = EMPTY_KEY;
+        uint64_t last_refill{};
+        uint64_t credit{}; // In microseconds, TOKEN_TIME is one token
+
+    };
+
+    Bucket table[TABLE_SIZE];
+    uint32_t endpoints{};
+
+    uint64_t unknown_window_start{};
+    uint32_t unknown_in_window{};
+
+public:
+    /* Drop metrics, since the last report */
+    uint64_t dropped_length{}, dropped_turn{}, dropped_rate{}, dropped_unknown{};
+
+    /* Returns false if datagram should be dropped without decoding */
+    bool accept(const uint8_t* datagram, ssize_t len,
+                const struct sockaddr_in& address, uint64_t now) {
+        if (len < 13 || len > (ssize_t) MAX_CLIENT_DATAGRAM_SIZE) {
+            dropped_length++;
+            return false;
+        }
+        if (datagram[8] > LEFT) {
+            dropped_turn++;
+            return false;
+        }
+
+        Bucket* bucket = find(get_key(address));
+        if (bucket != nullptr) {
+            bucket->credit = std::min(bucket->credit + now - bucket->last_refill, BUCKET_TIME);
+            bucket->last_refill = now;
+            if (bucket->credit < TOKEN_TIME) {
+                dropped_rate++;
+                return false;
+            }
+            bucket->credit -= TOKEN_TIME;
+            return true;
+        }
+
+        if (now - unknown_window_start >= 1000000) {
+            unknown_window_start = now;
+            unknown_in_window = 0;
+        }
+        if (unknown_in_window >= INGRESS_UNKNOWN_BUDGET) {
+            dropped_unknown++;
+            return false;
+        }
+        unknown_in_window++;
+        return true;
+    }
+
+    /* Endpoint became a client */
+    void add_endpoint(const struct sockaddr_in& address, uint64_t now) {
+        uint64_t key = get_key(address);
+        if (find(key) != nullptr || endpoints >= TABLE_SIZE / 2)
+            return; // Table full, endpoint shares budget of unknown ones
+        uint32_t slot = get_slot(key);
+        while (table[slot].key != EMPTY_KEY)
+            slot = (slot + 1) & (TABLE_SIZE - 1);
+        table[slot].key = key;
+        table[slot].last_refill = now;
+        table[slot].credit = BUCKET_TIME;
+        endpoints++;
+    }
+
+    void remove_endpoint(const struct sockaddr_in& address) {
+        Bucket* bucket = find(get_key(address));
+        if (bucket == nullptr)
+            return;
+
+        /* Move back entries which would become unreachable */
+        uint32_t hole = bucket - table;
+        for (uint32_t slot = (hole + 1) & (TABLE_SIZE - 1); table[slot].key != EMPTY_KEY;
+             slot = (slot + 1) & (TABLE_SIZE - 1)) {
+            uint32_t home = get_slot(table[slot].key);
+            if (((slot - home) & (TABLE_SIZE - 1)) >= ((slot - hole) & (TABLE_SIZE - 1))) {
+                table[hole] = table[slot];
+                hole = slot;
+            }
+        }
+        table[hole].key = EMPTY_KEY;
+        endpoints--;
+    }
+
+    /* Prints drops since the last report, if there were any */
+    void report(std::ostream& stream) {
+        if (dropped_length + dropped_turn + dropped_rate + dropped_unknown == 0)
+            return;
+        stream << "[INGRESS] dropped length " << dropped_length << " turn " << dropped_turn
+               << " rate " << dropped_rate << " unknown " << dropped_unknown << std::endl;
+        dropped_length = dropped_turn = dropped_rate = dropped_unknown = 0;
+    }
+
+private:
+    static uint64_t get_key(const struct sockaddr_in& address) {
+        /* Port 0 isn't used by clients, so key is never EMPTY_KEY */
+        return (uint64_t) address.sin_addr.s_addr << 16 | address.sin_port;
+    }
+
+    static uint32_t get_slot(uint64_t key) {
+        return (key * 0x9E3779B97F4A7C15ULL) >> (64 - TABLE_BITS); // Top bits
+    }
+
+    Bucket* find(uint64_t key) {
+        for (uint32_t slot = get_slot(key); table[slot].key != EMPTY_KEY;
+             slot = (slot + 1) & (TABLE_SIZE - 1))
+            if (table[slot].key == key)
+                return &table[slot];
+        return nullptr;
+    }
+
+};
+
+#endif //PROJEKT2_INGRESS_FILTER_H
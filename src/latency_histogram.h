@@ -0,0 +1,56 @@
+#ifndef PROJEKT2_LATENCY_HISTOGRAM_H
+#define PROJEKT2_LATENCY_HISTOGRAM_H
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+/* Latencies in microseconds, bucket i holds values from [2^(i-1), 2^i) */
+class LatencyHistogram {
+
+    static const uint8_t BUCKETS = 40;
+
+    uint64_t counts[BUCKETS]{};
+    uint64_t total{}, sum{}, max{};
+
+public:
+
+    void add(uint64_t latency) {
+        uint8_t bucket = latency == 0 ? 0 : 64 - __builtin_clzll(latency);
+        counts[std::min<uint8_t>(bucket, BUCKETS - 1)]++;
+        total++;
+        sum += latency;
+        max = std::max(max, latency);
+    }
+
+    void clear() {
+        *this = LatencyHistogram();
+    }
+
+    uint64_t get_total() const {
+        return total;
+    }
+
+    /* Upper bound of bucket in which given fraction of values is reached */
+    uint64_t percentile(double fraction) const {
+        uint64_t seen = 0;
+        for (uint8_t bucket = 0; bucket < BUCKETS; ++bucket) {
+            seen += counts[bucket];
+            if (seen > 0 && seen >= fraction * total)
+                return std::min<uint64_t>(bucket == 0 ? 0 : (1ULL << bucket) - 1, max);
+        }
+        return max;
+    }
+
+    void report(std::ostream& out, const std::string& name) const {
+        out << name << ": count " << total
+            << " avg " << (total == 0 ? 0 : sum / total) << "us"
+            << " p50 " << percentile(0.5) << "us"
+            << " p90 " << percentile(0.9) << "us"
+            << " p99 " << percentile(0.99) << "us"
+            << " max " << max << "us" << std::endl;
+    }
+
+};
+
+#endif //PROJEKT2_LATENCY_HISTOGRAM_H
@@ -0,0 +1,335 @@
+#ifndef PROJEKT2_LOAD_GENERATOR_H
+#define PROJEKT2_LOAD_GENERATOR_H
+
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <cstring>
+#include <endian.h>
+#include <fcntl.h>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "consts.h"
+#include "loadgen_options.h"
+#include "latency_histogram.h"
+#include "utils.h"
+#include "events.h"
+
+/*
+ * Emulates many clients from one process. Every session has its own socket
+ * (so its own port) and session_id and sends the same datagrams as
+ * ClientCommunicator::message_server. Incoming datagrams are collected with
+ * epoll and recvmmsg.
+ *
+ * Server and generator share a host but not a clock of event sending, so
+ * delivery latency of an event is measured from its first arrival at any
+ * session to its arrival at every other one.
+ *
+ * Optional flood from FLOOD_SOCKETS extra sockets shows whether the server
+ * keeps its pace under attack. Every socket sends observer messages asking
+ * for the whole log, datagrams with invalid turn direction and with wrong
+ * length.
+ */
+class LoadGenerator {
+
+    class Session {
+
+    public:
+        int sock;
+        uint64_t session_id;
+        std::string player_name;
+        uint8_t turn_direction;
+        uint32_t game_id{};
+        uint32_t next_expected_event_no{};
+        uint32_t script_pos{};
+
+        explicit Session(int sock, uint64_t session_id, std::string player_name)
+                    : sock(sock), session_id(session_id),
+                      player_name(std::move(player_name)),
+                      turn_direction(this->player_name.empty() ? FORWARD : RIGHT) {}
+
+    };
+
+    static const uint32_t RECV_BATCH = 32;
+    static const uint32_t EPOLL_BATCH = 256;
+    static const uint64_t MESSAGE_INTERVAL = 30000;
+    static const uint64_t REPORT_INTERVAL = 1000000;
+    static const uint32_t FLOOD_SOCKETS = 16;
+    static const uint32_t FLOOD_BATCH = 1024;
+
+    const LoadgenOptions options;
+    std::vector<Session> sessions;
+    int epoll_fd{};
+    struct sockaddr_in srvr_address{};
+    std::mt19937 random_generator;
+    std::vector<int> flood_socks;
+    uint64_t flood_sent{}, total_flood_sent{};
+
+    /* Receive batch */
+    std::vector<uint8_t> buffers; // RECV_BATCH datagrams of advertised size
+    struct iovec iovs[RECV_BATCH]{};
+    struct mmsghdr msgs[RECV_BATCH]{};
+    DecodedEvent decoded; // Framing and crc32 checked the same way as by client
+
+    /* Current game as seen by sessions, first arrival time of every event */
+    uint32_t game_id{};
+    bool game_seen = false;
+    std::vector<uint64_t> first_arrival;
+
+    /* Statistics of current report period and of whole run */
+    uint64_t datagrams{}, events{}, delivered_events{}, bad_datagrams{}, messages{};
+    uint64_t total_datagrams{}, total_events{}, total_delivered_events{};
+    LatencyHistogram period_latency, total_latency;
+
+public:
+
+    explicit LoadGenerator(LoadgenOptions options)
+                : options(std::move(options)), random_generator(get_time()),
+                  buffers(RECV_BATCH * this->options.datagram_size) {
+        init_server_address();
+        epoll_fd = epoll_create1(0);
+        if (epoll_fd < 0)
+            report_fail("Epoll initialization failed!");
+
+        uint64_t first_session_id = get_time();
+        uint32_t sessions_number = this->options.players + this->options.observers;
+        sessions.reserve(sessions_number);
+        for (uint32_t i = 0; i < sessions_number; ++i)
+            open_session(first_session_id + i,
+                         i < this->options.players ? "bot" + std::to_string(i) : "");
+
+        for (uint32_t i = 0; i < FLOOD_SOCKETS && this->options.flood_rate > 0; ++i)
+            flood_socks.push_back(open_socket());
+
+        for (uint32_t i = 0; i < RECV_BATCH; ++i) {
+            iovs[i] = {buffers.data() + i * options.datagram_size, options.datagram_size};
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+    }
+
+    void run() {
+        uint64_t start = get_time(),
+                 end = start + (uint64_t) options.duration * 1000000,
+                 next_message = start,
+                 next_report = start + REPORT_INTERVAL;
+        struct epoll_event ready[EPOLL_BATCH];
+
+        while (get_time() < end) {
+            uint64_t now = get_time();
+            int timeout = next_message > now && flood_socks.empty() ?
+                          (int) ((next_message - now) / 1000) : 0;
+            int ready_number = epoll_wait(epoll_fd, ready, EPOLL_BATCH, timeout);
+            for (int i = 0; i < ready_number; ++i)
+                receive(sessions[ready[i].data.u32]);
+
+            now = get_time();
+            if (!flood_socks.empty())
+                flood((now - start) * options.flood_rate / 1000000);
+            if (now >= next_message) {
+                for (auto& session : sessions)
+                    message_server(session);
+                next_message += MESSAGE_INTERVAL;
+            }
+            if (now >= next_report) {
+                report_period((now - start) / 1000000);
+                next_report += REPORT_INTERVAL;
+            }
+        }
+
+        report_total(get_time() - start);
+    }
+
+private:
+
+    int open_socket() {
+        int sock = socket(AF_INET, SOCK_DGRAM, 0);
+        if (sock < 0)
+            report_fail("Socket initialization failed!");
+        if (connect(sock, (struct sockaddr*) &srvr_address, sizeof(srvr_address)) < 0)
+            report_fail("Connecting to game server failed!");
+        fcntl(sock, F_SETFL, O_NONBLOCK);
+        return sock;
+    }
+
+    void open_session(uint64_t session_id, const std::string& player_name) {
+        int sock = open_socket();
+
+        struct epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u32 = sessions.size();
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sock, &event) < 0)
+            report_fail("Adding socket to epoll failed!");
+
+        sessions.emplace_back(sock, session_id, player_name);
+    }
+
+    void message_server(Session& session) {
+        if (!session.player_name.empty())
+            steer(session);
+
+        uint8_t buffer_w[MAX_CLIENT_DATAGRAM_SIZE];
+        *(uint64_t*)buffer_w = htobe64(session.session_id);
+        buffer_w[8] = session.turn_direction;
+        *(uint32_t*)(buffer_w + 9) = htonl(session.next_expected_event_no);
+        memcpy(buffer_w + 13, session.player_name.data(), session.player_name.size());
+        size_t buffer_len = 13 + session.player_name.size();
+        if (options.datagram_size > MAX_SERVER_DATAGRAM_SIZE) {
+            buffer_w[buffer_len] = '\0';
+            *(uint16_t*)(buffer_w + buffer_len + 1) = htons(options.datagram_size);
+            buffer_len += CLIENT_EXTENSION_SIZE;
+        }
+
+        if (send(session.sock, buffer_w, buffer_len, 0) > 0)
+            messages++;
+    }
+
+    /* Sends junk until total_flood_sent + flood_sent reaches due */
+    void flood(uint64_t due) {
+        uint8_t junk[MAX_CLIENT_DATAGRAM_SIZE + 8]{};
+        for (uint32_t i = 0; i < FLOOD_BATCH && total_flood_sent + flood_sent < due; ++i) {
+            uint32_t kind = random_generator() % 3;
+            *(uint64_t*)junk = htobe64(flood_sent % FLOOD_SOCKETS + 1); // Session of socket
+            junk[8] = kind == 1 ? LEFT + 1 + random_generator() % 100 : FORWARD;
+            size_t junk_len = kind == 2 ? random_generator() % 13 : 13;
+            if (kind == 2 && junk_len == 0)
+                junk_len = sizeof(junk); // Too long
+            send(flood_socks[flood_sent % FLOOD_SOCKETS], junk, junk_len, 0);
+            flood_sent++;
+        }
+    }
+
+    void steer(Session& session) {
+        if (!options.script.empty()) {
+            char move = options.script[session.script_pos++ % options.script.size()];
+            session.turn_direction = move == 'L' ? LEFT : move == 'R' ? RIGHT : FORWARD;
+        }
+        else if (random_generator() % 10 == 0) {
+            session.turn_direction = random_generator() % 3;
+        }
+    }
+
+    void receive(Session& session) {
+        int received;
+        do {
+            received = recvmmsg(session.sock, msgs, RECV_BATCH, MSG_DONTWAIT, nullptr);
+            uint64_t now = get_time();
+            for (int i = 0; i < received; ++i)
+                parse_datagram(session, (uint8_t*) iovs[i].iov_base, msgs[i].msg_len, now);
+        } while (received == RECV_BATCH);
+    }
+
+    void parse_datagram(Session& session, const uint8_t* datagram, uint32_t len,
+                        uint64_t now) {
+        datagrams++;
+        if (len < 4) {
+            bad_datagrams++;
+            return;
+        }
+        uint32_t datagram_game_id = ntohl(*(uint32_t*)datagram);
+
+        for (uint32_t pos = 4; pos < len; ) {
+            pos = decoded.decode(datagram, pos, len);
+            if (!decoded.crc32_valid) {
+                bad_datagrams++;
+                return;
+            }
+            uint32_t event_no = decoded.event_no;
+            uint8_t event_type = decoded.event_type;
+            events++;
+
+            if (datagram_game_id != session.game_id) {
+                /* Other game, asked for from its start like by client even if NEW_GAME was lost */
+                session.game_id = datagram_game_id;
+                session.next_expected_event_no = 0;
+            }
+            if (event_no == 0 && event_type == NEW_GAME &&
+                (!game_seen || datagram_game_id != game_id)) {
+                game_id = datagram_game_id;
+                game_seen = true;
+                first_arrival.clear();
+            }
+            if (datagram_game_id != session.game_id ||
+                event_no != session.next_expected_event_no)
+                continue; // Duplicate or out of order, client would ask again
+
+            session.next_expected_event_no++;
+            delivered_events++;
+            if (datagram_game_id != game_id)
+                continue;
+            if (event_no >= first_arrival.size())
+                first_arrival.resize(event_no + 1, 0);
+            if (first_arrival[event_no] == 0) {
+                first_arrival[event_no] = now;
+            }
+            else {
+                period_latency.add(now - first_arrival[event_no]);
+                total_latency.add(now - first_arrival[event_no]);
+            }
+        }
+    }
+
+    void report_period(uint64_t second) {
+        std::cout << "[" << second << "s] datagrams " << datagrams
+                  << " events " << events << " delivered " << delivered_events
+                  << " bad " << bad_datagrams << " sent " << messages;
+        if (!flood_socks.empty())
+            std::cout << " flood " << flood_sent;
+        std::cout << std::endl;
+        period_latency.report(std::cout, "  delivery latency");
+
+        total_datagrams += datagrams;
+        total_events += events;
+        total_delivered_events += delivered_events;
+        total_flood_sent += flood_sent;
+        datagrams = events = delivered_events = bad_datagrams = messages = flood_sent = 0;
+        period_latency.clear();
+    }
+
+    void report_total(uint64_t elapsed) {
+        total_datagrams += datagrams;
+        total_events += events;
+        total_delivered_events += delivered_events;
+        total_flood_sent += flood_sent;
+        double seconds = (double) elapsed / 1000000;
+
+        std::cout << "Sessions " << sessions.size() << " (" << options.players
+                  << " players, " << options.observers << " observers)" << std::endl;
+        std::cout << "Server throughput: " << total_datagrams / seconds << " datagrams/s, "
+                  << total_events / seconds << " events/s, "
+                  << total_delivered_events / seconds << " delivered events/s" << std::endl;
+        if (!flood_socks.empty())
+            std::cout << "Flood: " << total_flood_sent / seconds << " datagrams/s" << std::endl;
+        total_latency.report(std::cout, "Delivery latency");
+    }
+
+    void init_server_address() {
+        struct addrinfo addr_hints{};
+        struct addrinfo *addr_result;
+
+        addr_hints.ai_family = AF_INET; // IPv4
+        addr_hints.ai_socktype = SOCK_DGRAM;
+        addr_hints.ai_protocol = IPPROTO_UDP;
+        if (getaddrinfo(options.game_server.c_str(), nullptr,
+                        &addr_hints, &addr_result) != 0)
+            report_fail("Getting address info failed!");
+
+        srvr_address.sin_family = AF_INET; // IPv4
+        srvr_address.sin_addr.s_addr =
+                ((struct sockaddr_in*) (addr_result->ai_addr))->sin_addr.s_addr;
+        srvr_address.sin_port = htons(options.port_num);
+        freeaddrinfo(addr_result);
+    }
+
+    static void report_fail(const char* message) {
+        std::cerr << message << std::endl;
+        exit(1);
+    }
+
+};
+
+#endif //PROJEKT2_LOAD_GENERATOR_H
@@ -0,0 +1,11 @@
+#include "loadgen_options.h"
+#include "load_generator.h"
+
+
+int main(int argc, char *argv[])
+{
+    LoadgenOptions loadgen_options = LoadgenOptions(argc, argv);
+    static LoadGenerator load_generator = LoadGenerator(loadgen_options);
+
+    load_generator.run();
+}
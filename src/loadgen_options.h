@@ -0,0 +1,99 @@
+#ifndef PROJEKT2_LOADGEN_OPTIONS_H
+#define PROJEKT2_LOADGEN_OPTIONS_H
+
+#include <iostream>
+#include <unistd.h>
+#include <algorithm>
+
+#include "consts.h"
+
+class LoadgenOptions {
+
+public:
+    std::string game_server;
+    uint16_t port_num = DEFAULT_PORT_NUM;
+    uint32_t players = DEFAULT_LOADGEN_PLAYERS;
+    uint32_t observers = DEFAULT_LOADGEN_OBSERVERS;
+    uint32_t duration = DEFAULT_LOADGEN_DURATION;
+    std::string script{}; // Empty for random steering
+    uint32_t flood_rate{}; // Junk datagrams per second
+    uint16_t datagram_size = MAX_SERVER_DATAGRAM_SIZE; // Advertised only when bigger
+
+    LoadgenOptions(int argc, char *argv[]) {
+        if (argc < 2)
+            fail_constructor("Game server not provided!");
+        game_server = argv[1];
+
+        int64_t helpy;
+        int opt;
+        argc -= 1;
+        argv++;
+
+        while ((opt = getopt(argc, argv, "p:c:o:d:S:f:D:")) != -1) {
+            switch (opt) {
+                case 'p':
+                    helpy = strtol(optarg, nullptr, 10);
+                    if (helpy < 1 || helpy > MAX_PORT_NUM)
+                        fail_constructor("Port number invalid!");
+                    port_num = helpy;
+                    break;
+                case 'c':
+                    helpy = strtol(optarg, nullptr, 10);
+                    if (helpy < 0 || helpy > MAX_LOADGEN_SESSIONS)
+                        fail_constructor("Players number invalid!");
+                    players = helpy;
+                    break;
+                case 'o':
+                    helpy = strtol(optarg, nullptr, 10);
+                    if (helpy < 0 || helpy > MAX_LOADGEN_SESSIONS)
+                        fail_constructor("Observers number invalid!");
+                    observers = helpy;
+                    break;
+                case 'd':
+                    helpy = strtol(optarg, nullptr, 10);
+                    if (helpy <= 0)
+                        fail_constructor("Duration invalid!");
+                    duration = helpy;
+                    break;
+                case 'S':
+                    script = optarg;
+                    if (!is_script_valid())
+                        fail_constructor("Script invalid!");
+                    break;
+                case 'f':
+                    helpy = strtol(optarg, nullptr, 10);
+                    if (helpy < 0 || helpy > MAX_LOADGEN_FLOOD_RATE)
+                        fail_constructor("Flood rate invalid!");
+                    flood_rate = helpy;
+                    break;
+                case 'D':
+                    helpy = strtol(optarg, nullptr, 10);
+                    if (helpy < (int64_t) MAX_SERVER_DATAGRAM_SIZE ||
+                        helpy > (int64_t) MAX_UDP_PAYLOAD_SIZE)
+                        fail_constructor("Datagram size invalid!");
+                    datagram_size = helpy;
+                    break;
+                default:
+                    fail_constructor("Unrecognized program option!");
+            }
+        }
+        if (argv[optind] != nullptr)
+            fail_constructor("Trash in options!");
+        if (players + observers == 0 || players + observers > MAX_LOADGEN_SESSIONS)
+            fail_constructor("Sessions number invalid!");
+    }
+
+    static void fail_constructor(const char *message) {
+        std::cerr << message << std::endl;
+        exit(1);
+    }
+
+    /* Script is sequence of L, R and F, one letter for every message */
+    bool is_script_valid() const {
+        return std::all_of(script.begin(), script.end(), [](char c) {
+            return c == 'L' || c == 'R' || c == 'F'; });
+    }
+
+};
+
+#endif //PROJEKT2_LOADGEN_OPTIONS_H
@@ -0,0 +1,67 @@
+#ifndef PROJEKT2_MULTICAST_H
+#define PROJEKT2_MULTICAST_H
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <cstdlib>
+#include <string>
+
+#include "consts.h"
+
+/*
+ * Multicast group of live events for observers, given as group:port or
+ * group:port:interface. Interface is address of local interface, e.g.
+ * 127.0.0.1 to keep the group on loopback, by default kernel chooses it.
+ */
+class MulticastGroup {
+
+public:
+    struct sockaddr_in address{}; // Group and port
+    struct in_addr interface{};
+
+    bool is_enabled() const {
+        return address.sin_port != 0;
+    }
+
+    /* Returns false if text isn't multicast group with port and optional interface */
+    bool parse(const std::string& text) {
+        size_t port_pos = text.find(':');
+        if (port_pos == std::string::npos)
+            return false;
+        size_t interface_pos = text.find(':', port_pos + 1);
+        std::string group = text.substr(0, port_pos);
+        std::string port = text.substr(port_pos + 1, interface_pos == std::string::npos
+                                                     ? std::string::npos
+                                                     : interface_pos - port_pos - 1);
+        int64_t port_num = strtol(port.c_str(), nullptr, 10);
+
+        address.sin_family = AF_INET;
+        if (inet_pton(AF_INET, group.c_str(), &address.sin_addr) != 1 ||
+            !IN_MULTICAST(ntohl(address.sin_addr.s_addr)) ||
+            port_num < 1 || port_num > MAX_PORT_NUM)
+            return false;
+        address.sin_port = htons(port_num);
+
+        interface.s_addr = htonl(INADDR_ANY);
+        return interface_pos == std::string::npos ||
+               inet_pton(AF_INET, text.substr(interface_pos + 1).c_str(), &interface) == 1;
+    }
+
+    /* Sending socket, datagrams to the group leave through the interface */
+    bool set_sending_interface(int sock) const {
+        return setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, &interface, sizeof(interface)) == 0;
+    }
+
+    /* Socket bound to the group port receives datagrams of the group */
+    bool join(int sock) const {
+        struct ip_mreq membership{};
+        membership.imr_multiaddr = address.sin_addr;
+        membership.imr_interface = interface;
+        return setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP,
+                          &membership, sizeof(membership)) == 0;
+    }
+
+};
+
+#endif //PROJEKT2_MULTICAST_H
@@ -0,0 +1,42 @@
+#include "relay_options.h"
+#include "relay_communicator.h"
+#include "server_communicator.h"
+#include "utils.h"
+
+
+[[noreturn]] void run_relay(RelayCommunicator& upstream, ServerCommunicator& downstream) {
+    uint64_t moment_length = 30000,
+             moment_start = get_time();
+
+    while (true) {
+        if (get_time() - moment_start >= moment_length) {
+            /* Send routine message upstream and forget silent observers */
+            upstream.message_server();
+            downstream.remove_inactive_clients();
+            moment_start = get_time();
+        }
+
+        /* If upstream sent anything, pass new events to every observer */
+        uint32_t first_new_event_no = upstream.parse_message();
+        downstream.send_events_to_everyone(upstream.events, first_new_event_no,
+                                           upstream.game_id);
+
+        /* If any observer sent anything, it is served from local log */
+        downstream.parse_message(upstream.events, upstream.game_id);
+        downstream.flush();
+    }
+
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t session_id = get_time();
+    RelayOptions relay_options = RelayOptions(argc, argv);
+    uint16_t listen_port_num = relay_options.listen_port_num;
+    RelayCommunicator upstream = RelayCommunicator(relay_options, session_id);
+    /* Turns aren't passed upstream, so there are no players downstream */
+    ServerCommunicator downstream = ServerCommunicator(
+            listen_port_num, 0, MAX_OBSERVERS_NUMBER);
+
+    run_relay(upstream, downstream);
+}
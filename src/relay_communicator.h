@@ -0,0 +1,151 @@
+#ifndef PROJEKT2_RELAY_COMMUNICATOR_H
+#define PROJEKT2_RELAY_COMMUNICATOR_H
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <cstring>
+#include <utility>
+#include <endian.h>
+#include <fcntl.h>
+#include <vector>
+#include <string>
+
+#include "consts.h"
+#include "relay_options.h"
+#include "utils.h"
+#include "events.h"
+
+/*
+ * Upstream side of a relay. Connects to the game server (or another relay)
+ * as a single observer and keeps a local copy of the current game's event log,
+ * which is then served downstream by a ServerCommunicator.
+ */
+class RelayCommunicator {
+
+    const RelayOptions relay_options;
+    const uint64_t session_id;
+    uint8_t buffer_w[MAX_CLIENT_DATAGRAM_SIZE]{};
+    uint8_t buffer_r[MAX_SERVER_DATAGRAM_SIZE]{};
+    int sock{};
+    struct sockaddr_in srvr_address{};
+
+public:
+
+    /* Cached log of the current game, always without gaps */
+    std::vector<Event> events;
+    uint32_t game_id{};
+
+    explicit RelayCommunicator(RelayOptions relay_options, uint64_t session_id)
+                    : relay_options(std::move(relay_options)), session_id(session_id) {
+        init_server_connection();
+    }
+
+    void message_server() {
+        /* Observer message - empty player name and no turning */
+        *(uint64_t*)buffer_w = htobe64(session_id);
+        buffer_w[8] = FORWARD;
+        *(uint32_t*)(buffer_w + 9) = htonl(events.size());
+
+        size_t buffer_len = 13;
+        ssize_t rcva_len = (socklen_t) sizeof(srvr_address);
+
+        if (sendto(sock, buffer_w, buffer_len, 0,(struct sockaddr*) &srvr_address,
+                   rcva_len) != buffer_len) {
+            // Just report error, next message will be sent in a moment
+            std::cerr << "Sending buffer to " << srvr_address.sin_addr.s_addr
+                      << ":" << srvr_address.sin_port << " failed!" << std::endl;
+        }
+    }
+
+    /*
+     * Receives one datagram from upstream. Returns number of the first event
+     * that was appended to the log, events.size() if nothing new arrived.
+     */
+    uint32_t parse_message() {
+        uint32_t first_new_event_no = events.size();
+        ssize_t len = recv(sock, buffer_r, sizeof(buffer_r), 0);
+        if (len < 4)
+            return first_new_event_no;
+
+        uint32_t datagram_game_id = ntohl(*(uint32_t*)buffer_r);
+        uint32_t parsed_len = 4;
+
+        while (len > parsed_len) {
+            uint32_t event_len, event_no;
+            if (!check_event(parsed_len, len, event_len))
+                break; // Rest of datagram is unusable
+            event_no = load_wire<uint32_t>(buffer_r + parsed_len + 4);
+
+            if (event_no == 0 && buffer_r[parsed_len + 8] == NEW_GAME &&
+                (datagram_game_id != game_id || events.empty())) {
+                /* New game started upstream, drop the old log */
+                events.clear();
+                game_id = datagram_game_id;
+                first_new_event_no = 0;
+            }
+            else if (datagram_game_id != game_id) {
+                /* We missed beginning of a new game, ask for it from scratch */
+                events.clear();
+                return 0;
+            }
+
+            if (event_no == events.size())
+                append_event_from_record(events, buffer_r + parsed_len);
+            parsed_len += event_len + 8;
+        }
+
+        return first_new_event_no;
+    }
+
+private:
+
+    /* Checks whether event starting at parsed_len fits in datagram and has valid crc */
+    bool check_event(uint32_t parsed_len, ssize_t len, uint32_t& event_len) {
+        if (parsed_len + 4 > len)
+            return false;
+        event_len = load_wire<uint32_t>(buffer_r + parsed_len);
+        if (event_len < GameOverWire::length || (int64_t) event_len + 8 > len - parsed_len)
+            return false;
+
+        uint32_t crc32 = load_wire<uint32_t>(buffer_r + parsed_len + 4 + event_len);
+        return crc32 == generate_crc32(buffer_r + parsed_len, event_len + 4);
+    }
+
+    void init_server_connection() {
+        struct addrinfo addr_hints{};
+        struct addrinfo *addr_result;
+
+        (void) memset(&addr_hints, 0, sizeof(struct addrinfo));
+        addr_hints.ai_family = AF_INET; // IPv4
+        addr_hints.ai_socktype = SOCK_DGRAM;
+        addr_hints.ai_protocol = IPPROTO_UDP;
+        if (getaddrinfo(relay_options.game_server.c_str(), nullptr,
+                        &addr_hints, &addr_result) != 0)
+            report_fail("Getting address info failed!");
+
+        srvr_address.sin_family = AF_INET; // IPv4
+        srvr_address.sin_addr.s_addr =
+                ((struct sockaddr_in*) (addr_result->ai_addr))->sin_addr.s_addr; // address IP
+        srvr_address.sin_port = htons(relay_options.port_num);
+
+        freeaddrinfo(addr_result);
+
+        sock = socket(PF_INET, SOCK_DGRAM, 0);
+        if (sock < 0)
+            report_fail("Socket initialization failed!");
+        /* Receive only from our upstream */
+        if (connect(sock, (struct sockaddr*) &srvr_address, sizeof(srvr_address)) < 0)
+            report_fail("Connecting to game server failed!");
+        fcntl(sock , F_SETFL, O_NONBLOCK); // Set socket to nonblock
+    }
+
+    static void report_fail(const char* message) {
+        std::cerr << message << std::endl;
+        exit(1);
+    }
+
+};
+
+#endif //PROJEKT2_RELAY_COMMUNICATOR_H
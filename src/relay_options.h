@@ -0,0 +1,55 @@
+#ifndef PROJEKT2_RELAY_OPTIONS_H
+#define PROJEKT2_RELAY_OPTIONS_H
+
+#include <iostream>
+#include <unistd.h>
+
+#include "consts.h"
+
+class RelayOptions {
+
+public:
+    std::string game_server;
+    uint16_t port_num = DEFAULT_PORT_NUM;
+    uint16_t listen_port_num = DEFAULT_PORT_NUM;
+
+    RelayOptions(int argc, char *argv[]) {
+        if (argc < 2)
+            fail_constructor("Game server not provided!");
+        game_server = argv[1];
+
+        int64_t helpy;
+        int opt;
+        argc -= 1;
+        argv++;
+
+        while ((opt = getopt(argc, argv, "p:l:")) != -1) {
+            switch (opt) {
+                case 'p':
+                    helpy = strtol(optarg, nullptr, 10);
+                    if (helpy < 1 || helpy > MAX_PORT_NUM)
+                        fail_constructor("Port number invalid!");
+                    port_num = helpy;
+                    break;
+                case 'l':
+                    helpy = strtol(optarg, nullptr, 10);
+                    if (helpy < 1 || helpy > MAX_PORT_NUM)
+                        fail_constructor("Listen port number invalid!");
+                    listen_port_num = helpy;
+                    break;
+                default:
+                    fail_constructor("Unrecognized program option!");
+            }
+        }
+        if (argv[optind] != nullptr)
+            fail_constructor("Trash in options!");
+    }
+
+    static void fail_constructor(const char *message) {
+        std::cerr << message << std::endl;
+        exit(1);
+    }
+
+};
+
+#endif //PROJEKT2_RELAY_OPTIONS_H
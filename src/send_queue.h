@@ -0,0 +1,81 @@
+#ifndef PROJEKT2_SEND_QUEUE_H
+#define PROJEKT2_SEND_QUEUE_H
+
+#include <netinet/in.h>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "consts.h"
+
+/*
+ * Datagrams which socket couldn't take at the moment, in order of sending.
+ * Pool of SEND_QUEUE_CAPACITY datagrams is allocated once and used as a ring,
+ * datagram which doesn't fit or later fails for good is dropped and counted.
+ */
+class SendQueue {
+
+    class Datagram {
+
+    public:
+        struct sockaddr_in address;
+        std::vector<uint8_t> data; // Grows only for datagrams of negotiated size
+
+    };
+
+    std::vector<Datagram> pool;
+    uint32_t head{}, tail{}; // Positions of the oldest and after the newest datagram
+
+public:
+    /* Metrics, since the last report */
+    uint64_t queued{}, dropped{};
+    uint32_t max_depth{};
+
+    SendQueue(): pool(SEND_QUEUE_CAPACITY) {
+        for (auto& datagram : pool)
+            datagram.data.reserve(MAX_SERVER_DATAGRAM_SIZE);
+    }
+
+    bool is_empty() const {
+        return head == tail;
+    }
+
+    uint32_t size() const {
+        return tail - head;
+    }
+
+    /* Returns false when queue is full and datagram was dropped */
+    bool push(const uint8_t* data, uint16_t len, const struct sockaddr_in* address) {
+        if (size() == pool.size()) {
+            dropped++;
+            return false;
+        }
+        Datagram& datagram = pool[tail % pool.size()];
+        datagram.address = *address;
+        datagram.data.assign(data, data + len);
+        tail++;
+        queued++;
+        max_depth = std::max(max_depth, size());
+        return true;
+    }
+
+    const Datagram& front() const {
+        return pool[head % pool.size()];
+    }
+
+    void pop() {
+        head++;
+    }
+
+    /* Prints metrics since the last report, if anything was queued */
+    void report(std::ostream& stream) {
+        if (queued == 0 && dropped == 0)
+            return;
+        stream << "[SEND QUEUE] queued " << queued << " dropped " << dropped
+               << " max depth " << max_depth << " depth " << size() << std::endl;
+        queued = dropped = max_depth = 0;
+    }
+
+};
+
+#endif //PROJEKT2_SEND_QUEUE_H
@@ -1,35 +1,479 @@
-#include "client_options.h"
-#include "client_communicator.h"
+#include <thread>
+
+#include "server_options.h"
+#include "server_communicator.h"
+#include "game_state.h"
+#include "game_recording.h"
+#include "server_handoff.h"
 #include "utils.h"
+#include "trace_ring.h"
+#include "simulation_channel.h"
+
+
+/* Loop state which has to survive server upgrade */
+class RoundState {
+
+public:
+    bool game_rolling = false;
+    uint32_t round_no = 0;
+    uint64_t round_start = get_time();
+    uint32_t board_width{}, board_height{}; // Of the last started game
+
+    void save(HandoffWriter& writer) const {
+        writer.put(game_rolling);
+        writer.put(round_no);
+        writer.put(round_start); // Same clock in both processes
+        writer.put(board_width);
+        writer.put(board_height);
+    }
+
+    void load(HandoffReader& reader) {
+        game_rolling = reader.get<bool>();
+        round_no = reader.get<uint32_t>();
+        round_start = reader.get<uint64_t>();
+        board_width = reader.get<uint32_t>();
+        board_height = reader.get<uint32_t>();
+    }
+
+};
+
+/* Players are sorted alphabetically and numbered in that order, returns their names */
+std::vector<std::string> number_players(ServerCommunicator& communicator) {
+    sort(communicator.players.begin(), communicator.players.end());
+    std::vector<std::string> players_names;
+    for (auto& player : communicator.players) {
+        player.player_number = players_names.size();
+        players_names.push_back(player.player_name);
+    }
+    return players_names;
+}
+
+/*
+ * Starts new game for clients with non-empty names. Returns false if game
+ * has ended during worm spawning.
+ */
+template<uint32_t WIDTH, uint32_t HEIGHT>
+bool start_game(ServerCommunicator& communicator, GameState<WIDTH, HEIGHT>& game_state,
+                const ServerOptions& server_options) {
+    std::vector<std::string> players_names = number_players(communicator);
+    bool game_rolling = game_state.start_game(players_names, server_options.screen_width,
+                                              server_options.screen_height,
+                                              server_options.turning_speed);
+    communicator.send_events_to_everyone(game_state.events, 0, game_state.game_id);
+    return game_rolling;
+}
+
+/* Finishes round with turn directions of clients. Returns false after GAME_OVER */
+template<uint32_t WIDTH, uint32_t HEIGHT>
+bool finish_round(ServerCommunicator& communicator, GameState<WIDTH, HEIGHT>& game_state) {
+    uint32_t first_event_no = game_state.events.size();
+    uint8_t turn_directions[CLIENTS_MAX_NUMBER];
+    communicator.get_turn_directions(turn_directions);
+
+    bool game_rolling = game_state.finish_round(turn_directions);
+    communicator.send_events_to_everyone(game_state.events, first_event_no,
+                                         game_state.game_id);
+    return game_rolling;
+}
+
+template<uint32_t WIDTH, uint32_t HEIGHT>
+[[noreturn]] void hand_off_server(ServerCommunicator& communicator,
+                                  GameState<WIDTH, HEIGHT>& game_state,
+                                  GameRecorder& recorder, ServerHandoff& handoff,
+                                  const RoundState& round_state) {
+    communicator.stop_receiving(game_state.events, game_state.game_id);
+    recorder.finish_game(); // Successor doesn't continue recording
+
+    HandoffWriter writer;
+    round_state.save(writer);
+    communicator.save(writer);
+    game_state.save(writer);
+    handoff.send(communicator.get_socket(), writer.data);
+    exit(0);
+}
+
+void dump_trace_ring(const std::string& path) {
+    if (TraceRing::dump(path))
+        std::cerr << "[TRACE] ring dumped to " << path << std::endl;
+    else
+        std::cerr << "Dumping trace ring to " << path << " failed!" << std::endl;
+}
+
+template<uint32_t WIDTH, uint32_t HEIGHT>
+[[noreturn]] void run_server(ServerCommunicator& communicator,
+                             GameState<WIDTH, HEIGHT>& game_state,
+                             GameRecorder& recorder, ServerHandoff& handoff,
+                             RoundState& round_state, const ServerOptions& server_options) {
+    uint64_t round_length = 1000000 / server_options.rounds_per_sec,
+             report_start = get_time(),
+             slow_round_dump = 0; // Rounds longer than round_length dump ring, once per report
+    LatencyHistogram round_delay; // How late rounds are computed, only with -T
+
+    while (true) {
+        /* If any client sent anything */
+        communicator.parse_message(game_state.events, game_state.game_id);
+
+        if (!round_state.game_rolling && communicator.ready_to_play()) {
+            /* Every player is ready, start new game */
+            round_state.game_rolling = start_game(communicator, game_state, server_options);
+            round_state.round_no = 0;
+            round_state.board_width = server_options.screen_width;
+            round_state.board_height = server_options.screen_height;
+            recorder.start_game(game_state.game_id, server_options.rounds_per_sec);
+            recorder.record(game_state.events, round_state.round_no);
+            if (!round_state.game_rolling) {
+                communicator.set_not_ready();
+                recorder.finish_game();
+            }
+            round_state.round_start = get_time();
+        }
+
+        if (get_time() - round_state.round_start >= round_length) {
+            /* Round has ended */
+            if (server_options.trace)
+                round_delay.add(get_time() - round_state.round_start - round_length);
+            communicator.remove_inactive_clients();
+            if (round_state.game_rolling) {
+                uint64_t round_time = get_time();
+                communicator.trace_round_start(round_time);
+                TRACE_PROBE(round_start, round_state.round_no + 1);
+                round_state.game_rolling = finish_round(communicator, game_state);
+                communicator.flush();
+                TRACE_PROBE(round_end, round_state.round_no + 1);
+                communicator.trace_round_sent(round_time);
+                if (!server_options.trace_dump_path.empty() &&
+                    get_time() - round_time > round_length &&
+                    get_time() - slow_round_dump >= TRACE_REPORT_INTERVAL) {
+                    dump_trace_ring(server_options.trace_dump_path);
+                    slow_round_dump = get_time();
+                }
+                recorder.record(game_state.events, ++round_state.round_no);
+                if (!round_state.game_rolling) {
+                    communicator.set_not_ready();
+                    recorder.finish_game();
+                }
+            }
+            round_state.round_start = get_time();
+
+            if (get_time() - report_start >= TRACE_REPORT_INTERVAL) {
+                if (server_options.trace) {
+                    round_delay.report(std::cerr, "[TRACE] round delay");
+                    communicator.report_trace();
+                }
+                communicator.report_drops();
+                report_start = get_time();
+            }
+
+            /* New server process is waiting to take over */
+            if (handoff.is_requested()) {
+                communicator.flush();
+                hand_off_server(communicator, game_state, recorder, handoff, round_state);
+            }
+        }
+
+        /* Send everything queued in this iteration */
+        communicator.flush();
+
+        if (TraceRing::is_dump_requested())
+            dump_trace_ring(server_options.trace_dump_path);
+    }
+
+}
+
+/* Copies events from first_event_no to the channel, waits while network thread is behind */
+template<uint32_t WIDTH, uint32_t HEIGHT>
+void publish_round(SimulationChannel& channel, const GameState<WIDTH, HEIGHT>& game_state,
+                   uint32_t first_event_no, const RoundState& round_state, uint64_t round_time) {
+    for (uint32_t event_no = first_event_no; event_no < game_state.events.size(); ++event_no)
+        while (!channel.events.push(game_state.events[event_no]))
+            std::this_thread::yield();
+    RoundEnd round_end{game_state.game_id, round_state.round_no,
+                       (uint32_t) game_state.events.size() - first_event_no,
+                       round_state.game_rolling, round_time};
+    while (!channel.rounds.push(round_end))
+        std::this_thread::yield();
+}
+
+/*
+ * Simulation thread of -S, keeps round timing and computes rounds. Sends
+ * nothing itself, so rounds are on time even when network thread is busy.
+ * Returns when network thread asks it to stop.
+ */
+template<uint32_t WIDTH, uint32_t HEIGHT>
+void run_simulation(SimulationChannel& channel, GameState<WIDTH, HEIGHT>& game_state,
+                    RoundState& round_state, const ServerOptions& server_options) {
+    uint64_t round_length = 1000000 / server_options.rounds_per_sec,
+             report_start = get_time();
+    LatencyHistogram round_delay; // How late rounds are computed, only with -T
+
+    while (!channel.stopping.load(std::memory_order_acquire)) {
+        std::vector<std::string>* players_names = channel.game_starts.front();
+        if (!round_state.game_rolling && players_names != nullptr) {
+            /* Every player is ready, start new game */
+            uint64_t round_time = get_time();
+            round_state.game_rolling = game_state.start_game(
+                    *players_names, server_options.screen_width,
+                    server_options.screen_height, server_options.turning_speed);
+            channel.game_starts.pop();
+            round_state.round_no = 0;
+            round_state.board_width = server_options.screen_width;
+            round_state.board_height = server_options.screen_height;
+            publish_round(channel, game_state, 0, round_state, round_time);
+            round_state.round_start = get_time();
+        }
+
+        uint64_t round_end = round_state.round_start + round_length;
+        if (get_time() < round_end) {
+            uint64_t sleep = round_state.game_rolling ? round_end - get_time()
+                                                      : SIMULATION_IDLE_SLEEP;
+            std::this_thread::sleep_for(std::chrono::microseconds(
+                    std::min(sleep, SIMULATION_IDLE_SLEEP)));
+            continue;
+        }
 
+        /* Round has ended */
+        if (server_options.trace)
+            round_delay.add(get_time() - round_state.round_start - round_length);
+        if (round_state.game_rolling) {
+            uint64_t round_time = get_time();
+            uint32_t first_event_no = game_state.events.size();
+            uint8_t turn_directions[CLIENTS_MAX_NUMBER];
+            for (uint8_t player_number = 0; player_number < CLIENTS_MAX_NUMBER; ++player_number)
+                turn_directions[player_number] =
+                        channel.turn_directions[player_number].load(std::memory_order_relaxed);
 
-[[noreturn]] void run_client(ClientCommunicator& communicator) {
-    uint64_t moment_length = 30000,
-             moment_start = get_time();
+            TRACE_PROBE(round_start, round_state.round_no + 1);
+            round_state.game_rolling = game_state.finish_round(turn_directions);
+            round_state.round_no++;
+            TRACE_PROBE(round_end, round_state.round_no);
+            publish_round(channel, game_state, first_event_no, round_state, round_time);
+            if (get_time() - round_time > round_length)
+                channel.slow_round.store(true, std::memory_order_relaxed);
+        }
+        round_state.round_start = get_time();
+
+        if (server_options.trace && get_time() - report_start >= TRACE_REPORT_INTERVAL) {
+            round_delay.report(std::cerr, "[TRACE] round delay");
+            report_start = get_time();
+        }
+    }
+    channel.stopped.store(true, std::memory_order_release);
+}
+
+/*
+ * Network thread of -S. Passes new events of rounds to clients and to
+ * recording, returns false after GAME_OVER.
+ */
+bool forward_rounds(ServerCommunicator& communicator, SimulationChannel& channel,
+                    GameEvents& events, uint32_t& game_id, bool game_rolling,
+                    GameRecorder& recorder, const ServerOptions& server_options) {
+    for (RoundEnd* round_end; (round_end = channel.rounds.front()) != nullptr;
+         channel.rounds.pop()) {
+        if (round_end->round_no == 0) {
+            events.clear();
+            game_id = round_end->game_id;
+            recorder.start_game(game_id, server_options.rounds_per_sec);
+        }
+        uint32_t first_event_no = events.size();
+        for (uint32_t i = 0; i < round_end->events_number; ++i) {
+            events.push_back(std::move(*channel.events.front()));
+            channel.events.pop();
+        }
+
+        communicator.trace_round_start(round_end->round_time);
+        communicator.send_events_to_everyone(events, first_event_no, game_id);
+        communicator.flush();
+        communicator.trace_round_sent(round_end->round_time);
+        recorder.record(events, round_end->round_no);
+        game_rolling = round_end->game_rolling;
+        if (!game_rolling) {
+            communicator.set_not_ready();
+            recorder.finish_game();
+        }
+    }
+    return game_rolling;
+}
+
+template<uint32_t WIDTH, uint32_t HEIGHT>
+[[noreturn]] void run_split_server(ServerCommunicator& communicator,
+                                   GameState<WIDTH, HEIGHT>& game_state,
+                                   GameRecorder& recorder, ServerHandoff& handoff,
+                                   RoundState& round_state, const ServerOptions& server_options) {
+    /* Until simulation is stopped, game_state and round_state belong to it */
+    SimulationChannel channel;
+    GameEvents events = game_state.events;
+    uint32_t game_id = game_state.game_id;
+    bool game_rolling = round_state.game_rolling; // Also when start is requested
+    std::thread simulation([&]() {
+        run_simulation(channel, game_state, round_state, server_options);
+    });
+    uint64_t round_length = 1000000 / server_options.rounds_per_sec,
+             clients_check = get_time(),
+             report_start = get_time(),
+             slow_round_dump = 0;
 
     while (true) {
-        if (get_time() - moment_start >= moment_length) {
-            /* Send routine message */
-            communicator.message_server();
-            moment_start = get_time();
+        /* If any client sent anything */
+        communicator.parse_message(events, game_id);
+
+        if (!game_rolling && communicator.ready_to_play()) {
+            /* Every player is ready, simulation starts new game */
+            channel.game_starts.push(number_players(communicator));
+            game_rolling = true;
         }
 
-        /* If server sent anything */
-        communicator.parse_message();
+        uint8_t turn_directions[CLIENTS_MAX_NUMBER];
+        communicator.get_turn_directions(turn_directions);
+        for (uint8_t player_number = 0; player_number < CLIENTS_MAX_NUMBER; ++player_number)
+            channel.turn_directions[player_number].store(turn_directions[player_number],
+                                                         std::memory_order_relaxed);
+
+        game_rolling = forward_rounds(communicator, channel, events, game_id, game_rolling,
+                                      recorder, server_options);
+
+        if (get_time() - clients_check >= round_length) {
+            communicator.remove_inactive_clients();
+            clients_check = get_time();
+        }
 
-        /* If gui sever sent anything */
-        communicator.parse_gui_message();
+        if (get_time() - report_start >= TRACE_REPORT_INTERVAL) {
+            if (server_options.trace)
+                communicator.report_trace();
+            communicator.report_drops();
+            report_start = get_time();
+        }
+
+        if (channel.slow_round.exchange(false, std::memory_order_relaxed) &&
+            !server_options.trace_dump_path.empty() &&
+            get_time() - slow_round_dump >= TRACE_REPORT_INTERVAL) {
+            dump_trace_ring(server_options.trace_dump_path);
+            slow_round_dump = get_time();
+        }
+
+        /* New server process is waiting to take over */
+        if (handoff.is_requested()) {
+            channel.stopping.store(true, std::memory_order_release);
+            while (!channel.stopped.load(std::memory_order_acquire)) // Round may be published
+                forward_rounds(communicator, channel, events, game_id, game_rolling,
+                               recorder, server_options);
+            simulation.join();
+            forward_rounds(communicator, channel, events, game_id, game_rolling,
+                           recorder, server_options);
+            communicator.flush();
+            hand_off_server(communicator, game_state, recorder, handoff, round_state);
+        }
 
+        /* Send everything queued in this iteration */
+        communicator.flush();
+
+        if (TraceRing::is_dump_requested())
+            dump_trace_ring(server_options.trace_dump_path);
+    }
+
+}
+
+/* Board size known at compile time makes game state specialized for it */
+template<uint32_t WIDTH, uint32_t HEIGHT>
+[[noreturn]] void run_game(ServerCommunicator& communicator, GameRecorder& recorder,
+                           ServerHandoff& handoff, RoundState& round_state,
+                           HandoffReader* handed_off_reader,
+                           const ServerOptions& server_options) {
+    static GameState<WIDTH, HEIGHT> game_state(server_options.seed); // Too big for stack
+    if (handed_off_reader != nullptr)
+        game_state.load(*handed_off_reader);
+
+    if (server_options.split_threads)
+        run_split_server(communicator, game_state, recorder, handoff, round_state,
+                         server_options);
+    run_server(communicator, game_state, recorder, handoff, round_state, server_options);
+}
+
+/* Serves recorded game, events become visible in the pace they were played */
+[[noreturn]] void run_replay(ServerCommunicator& communicator, GameRecording& recording,
+                             const ServerOptions& server_options) {
+    uint64_t round_length = 1000000 / ((uint64_t) recording.rounds_per_sec *
+                                       server_options.replay_speed),
+             round_start = get_time();
+    uint32_t round_no = 0;
+
+    while (true) {
+        /* If any client sent anything */
+        communicator.parse_message(recording, recording.game_id);
+
+        if (get_time() - round_start >= round_length) {
+            /* Round has ended, reveal its events */
+            communicator.remove_inactive_clients();
+            uint32_t first_event_no = recording.visible_events;
+            while (recording.visible_events < recording.events_number &&
+                   recording.get_round(recording.visible_events) <= round_no)
+                recording.visible_events++;
+            communicator.send_events_to_everyone(recording, first_event_no,
+                                                 recording.game_id);
+            round_no++;
+            round_start = get_time();
+        }
+
+        /* Send everything queued in this iteration */
+        communicator.flush();
+
+        if (TraceRing::is_dump_requested())
+            dump_trace_ring(server_options.trace_dump_path);
     }
 
 }
 
 int main(int argc, char *argv[])
 {
-    uint64_t session_id = get_time();
-    ClientOptions client_options = ClientOptions(argc, argv);
-    ClientCommunicator communicator =
-            ClientCommunicator(client_options, session_id);
+    ServerOptions server_options = ServerOptions(argc, argv);
+    ServerHandoff handoff = ServerHandoff(server_options.upgrade_path);
+    int handed_off_sock = -1;
+    std::vector<uint8_t> handed_off_state;
+    handoff.receive(handed_off_sock, handed_off_state);
+
+    ServerCommunicator communicator = ServerCommunicator(
+            server_options.port_num, CLIENTS_MAX_NUMBER, server_options.observers_max_number,
+            true, server_options.use_io_uring, handed_off_sock);
+    if (server_options.trace)
+        communicator.enable_tracing();
+    if (server_options.multicast_group.is_enabled())
+        communicator.enable_multicast(server_options.multicast_group);
+    if (!server_options.trace_dump_path.empty()) {
+        TraceRing::enable();
+        TraceRing::dump_on_signal();
+    }
 
-    run_client(communicator);
-}
\ No newline at end of file
+    if (!server_options.replay_path.empty()) {
+        GameRecording recording = GameRecording(server_options.replay_path);
+        run_replay(communicator, recording, server_options);
+    }
+
+    GameRecorder recorder = GameRecorder(server_options.record_directory);
+    RoundState round_state;
+    HandoffReader reader(handed_off_state.data(), handed_off_state.size());
+    if (handed_off_sock >= 0) {
+        /* Continue where previous server process stopped */
+        round_state.load(reader);
+        communicator.load(reader);
+    }
+    handoff.listen_for_successor();
+
+    /* Game handed off from server with other board size needs dynamic board */
+    bool board_fixed = round_state.board_width == 0 ||
+                       (round_state.board_width == server_options.screen_width &&
+                        round_state.board_height == server_options.screen_height);
+    if (board_fixed && server_options.screen_width == 640 &&
+        server_options.screen_height == 480)
+        run_game<640, 480>(communicator, recorder, handoff, round_state,
+                           handed_off_sock >= 0 ? &reader : nullptr, server_options);
+    if (board_fixed && server_options.screen_width == 800 &&
+        server_options.screen_height == 600)
+        run_game<800, 600>(communicator, recorder, handoff, round_state,
+                           handed_off_sock >= 0 ? &reader : nullptr, server_options);
+    if (board_fixed && server_options.screen_width == 1024 &&
+        server_options.screen_height == 768)
+        run_game<1024, 768>(communicator, recorder, handoff, round_state,
+                            handed_off_sock >= 0 ? &reader : nullptr, server_options);
+    run_game<DYNAMIC_BOARD, DYNAMIC_BOARD>(communicator, recorder, handoff, round_state,
+                                           handed_off_sock >= 0 ? &reader : nullptr,
+                                           server_options);
+}
@@ -3,15 +3,28 @@
 
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/epoll.h>
 #include <fcntl.h>
 #include <arpa/inet.h>
 #include <utility>
 #include <vector>
+#include <unordered_map>
+#include <unordered_set>
 #include <algorithm>
+#include <cerrno>
+#include <cstring>
 
 #include "consts.h"
 #include "utils.h"
 #include "events.h"
+#include "uring_socket.h"
+#include "server_handoff.h"
+#include "latency_histogram.h"
+#include "ingress_filter.h"
+#include "send_queue.h"
+#include "trace_ring.h"
+#include "multicast.h"
 
 class ServerCommunicator {
 
@@ -26,6 +39,8 @@ private:
         struct sockaddr_in client_address{};
         uint8_t last_turn_direction; // To remember initial turn direction
         uint8_t player_number = CLIENTS_MAX_NUMBER; // Number in game_state
+        uint64_t turn_change_time{}; // Only when tracing, 0 if change was used
+        uint16_t datagram_size = MAX_SERVER_DATAGRAM_SIZE; // Advertised by client
 
 
         explicit ClientData(uint64_t session_id, uint64_t last_message_time,
@@ -54,167 +69,551 @@ private:
 
     /* Communication fields */
     uint16_t port_num;
-    uint8_t buffer_w[MAX_SERVER_DATAGRAM_SIZE]{};
+    size_t clients_max_number; // Of players
+    size_t observers_max_number;
+    std::vector<uint8_t> buffer_w; // Grows to the biggest datagram size of clients
     uint8_t buffer_r[MAX_CLIENT_DATAGRAM_SIZE]{};
     uint16_t buffer_pos = 0;
     int sock = 0;
 
+    /* Segmentation offload batch, datagrams for one client waiting to be sent */
+    bool gso_enabled = false;
+    bool gso_batching = false;
+    uint8_t gso_buffer[MAX_UDP_PAYLOAD_SIZE]{}; // Limit of a single send
+    uint32_t gso_buffer_pos = 0;
+    uint16_t gso_segment_size = 0;
+    uint8_t gso_segments = 0;
+    const struct sockaddr_in* gso_address = nullptr;
+
+    /* Optional io_uring backend, plain syscalls are used when it's inactive */
+    UringSocket uring;
+
+    /* Checks made before decoding of received datagram */
+    IngressFilter ingress_filter;
+
+    /* Datagrams refused by full socket, sent again when it becomes writable */
+    SendQueue send_queue;
+    int writable_epoll = -1; // Watches socket for EPOLLOUT, created on first refusal
+
     /* Last received message information */
     uint64_t session_id{};
     uint8_t turn_direction{};
     uint32_t next_expected_event_no{};
     std::string player_name;
+    uint16_t datagram_size{};
     struct sockaddr_in client_address{};
 
-public:
+    /* Observers lookup, by endpoint (position in observers) and by session */
+    std::unordered_map<uint64_t, uint32_t> observer_endpoints;
+    std::unordered_set<uint64_t> observer_sessions;
+    uint64_t observers_check{};
 
-    /* Client information fields */
-    std::vector<ClientData> client_data;
+    /* Live events for observers, packed once for every datagram size */
+    std::vector<uint8_t> observer_datagrams;
+    std::vector<uint32_t> observer_datagram_ends;
+    std::vector<struct mmsghdr> observer_msgs;
+    std::vector<struct iovec> observer_iovs;
+    uint32_t observer_batch_size = 0;
+
+    /* Live events for observers go once to multicast group, when enabled */
+    bool multicast_enabled = false;
+    ClientData multicast_group{0, 0, "", FORWARD};
+
+    /* Input tracing, round in which received turn changes are used */
+    bool tracing = false;
+    bool round_traced = false;
+    LatencyHistogram receive_to_round, round_to_send;
+
+public:
 
-    explicit ServerCommunicator(uint16_t port_num): port_num(port_num) {
-        init_socket();
+    /*
+     * Client information fields. Players have non-empty names, rounds look
+     * only at them. Observers are kept apart, their number only adds sending.
+     */
+    std::vector<ClientData> players;
+    std::vector<ClientData> observers;
+
+    explicit ServerCommunicator(uint16_t port_num,
+                                size_t clients_max_number = CLIENTS_MAX_NUMBER,
+                                size_t observers_max_number = DEFAULT_OBSERVERS_MAX_NUMBER,
+                                bool use_gso = true, bool use_io_uring = false,
+                                int handed_off_sock = -1)
+                    : port_num(port_num), clients_max_number(clients_max_number),
+                      observers_max_number(observers_max_number),
+                      buffer_w(MAX_SERVER_DATAGRAM_SIZE),
+                      observer_msgs(OBSERVER_SEND_BATCH), observer_iovs(OBSERVER_SEND_BATCH) {
+        if (handed_off_sock >= 0)
+            sock = handed_off_sock; // Already bound by previous server process
+        else
+            init_socket();
+        if (use_io_uring && !uring.init(sock))
+            std::cerr << "io_uring not available, using plain syscalls" << std::endl;
+        if (use_gso && !uring.is_active())
+            gso_enabled = is_gso_supported();
     }
 
-    void parse_message(const std::vector<Event>& events, uint32_t game_id) {
+    /* EventLog is GameEvents or GameRecording */
+    template<typename EventLog>
+    void parse_message(const EventLog& events, uint32_t game_id) {
         if (receive_message() == EMPTY)
             return; // No message sent
 
-        for (auto client : client_data) {
-            if (client.client_address.sin_port == client_address.sin_port &&
-                client.client_address.sin_addr.s_addr ==
-                       client_address.sin_addr.s_addr) {
-
-                if (client.session_id == session_id) {
-                    /* Update client */
-                    client.last_message_time = get_time();
-                    client.last_turn_direction = turn_direction;
-                    if (turn_direction != FORWARD)
-                        client.want_to_play = true;
-                    send_events(events, next_expected_event_no, game_id, client);
-                    return;
-                }
-                else if (client.session_id < session_id) {
-                    /* Reset this client (disconnect him from game to) */
-                    client.last_message_time = get_time();
-                    client.last_turn_direction = turn_direction;
-                    client.session_id = session_id;
-
-                    client.player_name = player_name;
-                    client.player_number = CLIENTS_MAX_NUMBER; // It's a new client
-                    if (turn_direction != FORWARD)
-                        client.want_to_play = true;
-                    send_events(events, next_expected_event_no, game_id, client);
-                    return;
+        ClientData* client = find_client(client_address);
+        if (client != nullptr) {
+            if (client->session_id == session_id) {
+                /* Update client */
+                if (tracing && turn_direction != client->last_turn_direction)
+                    client->turn_change_time = get_time();
+                client->last_message_time = get_time();
+                client->last_turn_direction = turn_direction;
+                client->datagram_size = datagram_size;
+                if (turn_direction != FORWARD)
+                    client->want_to_play = true;
+                send_events(events, next_expected_event_no, game_id, *client);
+                return;
+            }
+            if (client->session_id > session_id)
+                return; // When new session_id is lower then previous do nothing
+
+            if (client->player_name.empty() != player_name.empty()) {
+                /* Player became observer or the other way, added again below */
+                remove_client(client_address);
+            }
+            else {
+                /* Reset this client (disconnect him from game to) */
+                if (client->player_name.empty()) {
+                    observer_sessions.erase(client->session_id);
+                    observer_sessions.insert(session_id);
                 }
-                /* When new session_id is lower then previous do nothing */
+                client->last_message_time = get_time();
+                client->last_turn_direction = turn_direction;
+                client->session_id = session_id;
+                client->datagram_size = datagram_size;
+
+                client->player_name = player_name;
+                client->player_number = CLIENTS_MAX_NUMBER; // It's a new client
+                if (turn_direction != FORWARD)
+                    client->want_to_play = true;
+                send_events(events, next_expected_event_no, game_id, *client);
+                return;
             }
         }
 
         /* Message was sent from unknown socket */
 
-        for (const auto& client : client_data) {
-            if (client.session_id == session_id) {
-                /* New socket but existing session_id - do nothing */
+        if (observer_sessions.count(session_id) > 0)
+            return; // New socket but existing session_id - do nothing
+        for (const auto& player : players)
+            if (player.session_id == session_id)
                 return;
-            }
-        }
 
         /* Socket and session_id are new */
 
-        if (client_data.size() == CLIENTS_MAX_NUMBER)
-            return; /* Client limit */
-
-        client_data.emplace_back(session_id, get_time(), player_name, turn_direction);
-        client_data.back().client_address.sin_port = client_address.sin_port;
-        client_data.back().client_address.sin_addr.s_addr = client_address.sin_addr.s_addr;
-        client_data.back().client_address.sin_family = client_address.sin_family;
+        ClientData new_client(session_id, get_time(), player_name, turn_direction);
+        new_client.client_address.sin_port = client_address.sin_port;
+        new_client.client_address.sin_addr.s_addr = client_address.sin_addr.s_addr;
+        new_client.client_address.sin_family = client_address.sin_family;
+        new_client.datagram_size = datagram_size;
+        add_client(std::move(new_client));
     }
 
     void set_not_ready() {
-        for (auto& client : client_data)
-            client.want_to_play = false;
+        for (auto& player : players)
+            player.want_to_play = false;
     }
 
     bool ready_to_play() const {
-        uint8_t ready_players = 0;
-        for (const auto& client : client_data) {
-            if (!client.player_name.empty()) {
-                if (!client.want_to_play) {
-                    /* Non-empty name player who didn't send first move */
-                    return false;
-                }
-                ready_players++;
+        for (const auto& player : players) {
+            if (!player.want_to_play) {
+                /* Player who didn't send first move */
+                return false;
             }
         }
         /* Check if at least 2 ready players */
-        return ready_players >= 2;
+        return players.size() >= 2;
     }
 
+    /* Observers are checked only every OBSERVERS_CHECK_INTERVAL */
     void remove_inactive_clients() {
-        client_data.erase(std::remove_if(client_data.begin(),
-                                         client_data.end(),
-                                         [](auto client){ return !client.is_active(); }),
-                          client_data.end());
+        auto inactive = std::stable_partition(players.begin(), players.end(),
+                                              [](const auto& client){ return client.is_active(); });
+        for (auto client = inactive; client != players.end(); ++client)
+            ingress_filter.remove_endpoint(client->client_address);
+        players.erase(inactive, players.end());
+
+        if (get_time() - observers_check < OBSERVERS_CHECK_INTERVAL)
+            return;
+        for (uint32_t i = 0; i < observers.size(); )
+            if (observers[i].is_active())
+                ++i;
+            else
+                remove_observer(i);
+        observers_check = get_time();
     }
 
-    uint8_t get_new_turn_direction(uint8_t player_number) const {
-        for (const auto& client : client_data)
-            if (client.player_number == player_number)
-                return client.last_turn_direction;
-        return NO_CHANGES; // When client disconnected
+    /* Indexed by player number, NO_CHANGES for players who disconnected */
+    void get_turn_directions(uint8_t* turn_directions) const {
+        memset(turn_directions, NO_CHANGES, CLIENTS_MAX_NUMBER);
+        for (const auto& client : players)
+            if (client.player_number != CLIENTS_MAX_NUMBER)
+                turn_directions[client.player_number] = client.last_turn_direction;
     }
 
-    void send_events_to_everyone(const std::vector<Event>& events, uint32_t event_no,
+    /* Players get their events first, audience size doesn't delay them */
+    template<typename EventLog>
+    void send_events_to_everyone(const EventLog& events, uint32_t event_no,
                                  uint32_t game_id) {
-        for (const auto& client : client_data)
-            send_events(events, event_no, game_id, client);
+        for (const auto& player : players)
+            send_events(events, event_no, game_id, player);
+        send_events_to_observers(events, event_no, game_id);
+    }
+
+    /*
+     * Events are packed once for every datagram size of observers, the same
+     * datagrams then go to all of them in batches of sendmmsg.
+     */
+    template<typename EventLog>
+    void send_events_to_observers(const EventLog& events, uint32_t event_no,
+                                  uint32_t game_id) {
+        if (observers.empty() || event_no >= events.size())
+            return; // No one to send to or no events to send
+        if (multicast_enabled) {
+            send_events(events, event_no, game_id, multicast_group);
+            return;
+        }
+        TRACE_PROBE(send_events_start, event_no);
+        std::vector<uint16_t> datagram_sizes; // Usually just one
+        for (const auto& observer : observers)
+            if (std::find(datagram_sizes.begin(), datagram_sizes.end(),
+                          observer.datagram_size) == datagram_sizes.end())
+                datagram_sizes.push_back(observer.datagram_size);
+
+        for (uint16_t datagram_size : datagram_sizes) {
+            flush_observer_batch(); // Batch points to datagrams packed before
+            pack_observer_datagrams(events, event_no, game_id, datagram_size);
+            for (const auto& observer : observers) {
+                if (observer.datagram_size != datagram_size)
+                    continue;
+                uint32_t start = 0;
+                for (uint32_t end : observer_datagram_ends) {
+                    add_to_observer_batch(observer_datagrams.data() + start, end - start,
+                                          &observer.client_address);
+                    start = end;
+                }
+            }
+        }
+        flush_observer_batch();
+        TRACE_PROBE(send_events_end, events.size() - event_no);
     }
 
-    void send_events(const std::vector<Event>& events, uint32_t event_no,
+    template<typename EventLog>
+    void send_events(const EventLog& events, uint32_t event_no,
                      uint32_t game_id, const ClientData& client) {
-        if (event_no == events.size())
+        if (event_no >= events.size())
             return; // No events to send
+        TRACE_PROBE(send_events_start, event_no);
+        uint32_t events_number = events.size() - event_no;
         bool first_in_datagram = true;
+        gso_batching = gso_enabled; // Every datagram goes to the same client
+        if (buffer_w.size() < client.datagram_size)
+            buffer_w.resize(client.datagram_size);
 
         for (; event_no < events.size(); ++event_no) {
             if (first_in_datagram)
                 add_header_to_buffer(game_id);
 
-            if (buffer_pos + events[event_no].get_length() + 8 > MAX_SERVER_DATAGRAM_SIZE) {
+            uint32_t record_length = get_record_length(events, event_no);
+            if (buffer_pos + record_length > client.datagram_size && buffer_pos > 4) {
                 /* New event cannot be added, send datagram */
                 send_and_clear_buffer(&client.client_address);
                 event_no -= 1; // To parse this event again
                 first_in_datagram = true;
             }
             else {
-                /* New event can be added */
-                const auto& event = events[event_no];
-                add_event_to_buffer(event);
+                /* New event can be added, one longer than datagram goes alone */
+                if (buffer_w.size() < buffer_pos + record_length)
+                    buffer_w.resize(buffer_pos + record_length);
+                buffer_pos += serialize_record(events, event_no, buffer_w.data() + buffer_pos);
                 first_in_datagram = false;
             }
         }
         send_and_clear_buffer(&client.client_address);
+
+        if (gso_batching)
+            flush_gso_batch();
+        gso_batching = false;
+        TRACE_PROBE(send_events_end, events_number);
+    }
+
+    void enable_tracing() {
+        tracing = true;
+    }
+
+    /* Observers get only catch-ups by unicast, they should join the group */
+    void enable_multicast(const MulticastGroup& group) {
+        if (!group.set_sending_interface(sock))
+            report_fail("Setting multicast interface failed!");
+        multicast_group.client_address = group.address;
+        multicast_enabled = true;
+    }
+
+    /* Turn changes received until now are used in round computed at round_time */
+    void trace_round_start(uint64_t round_time) {
+        if (!tracing)
+            return;
+        for (auto& client : players) {
+            if (client.turn_change_time != 0 && client.player_number != CLIENTS_MAX_NUMBER) {
+                receive_to_round.add(round_time - client.turn_change_time);
+                client.turn_change_time = 0;
+                round_traced = true;
+            }
+        }
+    }
+
+    /* Events of round computed at round_time were just sent */
+    void trace_round_sent(uint64_t round_time) {
+        if (!round_traced)
+            return;
+        round_to_send.add(get_time() - round_time);
+        round_traced = false;
+    }
+
+    void report_trace() const {
+        receive_to_round.report(std::cerr, "[TRACE] turn change received -> round");
+        round_to_send.report(std::cerr, "[TRACE] round -> events sent");
+    }
+
+    int get_socket() const {
+        return sock;
+    }
+
+    /*
+     * Prepares socket for handoff to another process. Datagrams already taken
+     * by io_uring are parsed here, the rest waits in the socket.
+     */
+    template<typename EventLog>
+    void stop_receiving(const EventLog& events, uint32_t game_id) {
+        if (!uring.is_active())
+            return;
+        uring.stop();
+        while (uring.has_received())
+            parse_message(events, game_id);
+        uring.stop(); // Sends made while parsing
+    }
+
+    void save(HandoffWriter& writer) const {
+        writer.put<uint32_t>(players.size() + observers.size());
+        for (const auto& client : players)
+            save_client(writer, client);
+        for (const auto& client : observers)
+            save_client(writer, client);
+    }
+
+    void load(HandoffReader& reader) {
+        players.clear();
+        observers.clear();
+        observer_endpoints.clear();
+        observer_sessions.clear();
+        for (auto clients = reader.get<uint32_t>(); clients > 0; --clients) {
+            auto client_session_id = reader.get<uint64_t>();
+            auto last_message_time = reader.get<uint64_t>();
+            std::string client_player_name = reader.get_string();
+            ClientData client(client_session_id, last_message_time, client_player_name, FORWARD);
+            client.want_to_play = reader.get<bool>();
+            client.client_address.sin_family = AF_INET;
+            client.client_address.sin_addr.s_addr = reader.get<in_addr_t>();
+            client.client_address.sin_port = reader.get<in_port_t>();
+            client.last_turn_direction = reader.get<uint8_t>();
+            client.player_number = reader.get<uint8_t>();
+            client.datagram_size = reader.get<uint16_t>();
+            add_client(std::move(client));
+        }
+    }
+
+    /* Prints drops of ingress filter and of send queue since the last report */
+    void report_drops() {
+        ingress_filter.report(std::cerr);
+        send_queue.report(std::cerr);
+    }
+
+    /* Hands datagrams queued during this loop iteration to the kernel */
+    void flush() {
+        if (uring.is_active())
+            uring.submit();
+        if (!send_queue.is_empty() && is_socket_writable())
+            flush_send_queue();
     }
 
 private:
+    static uint64_t get_endpoint_key(const struct sockaddr_in& address) {
+        return (uint64_t) address.sin_addr.s_addr << 16 | address.sin_port;
+    }
+
+    ClientData* find_client(const struct sockaddr_in& address) {
+        for (auto& player : players)
+            if (player.client_address.sin_port == address.sin_port &&
+                player.client_address.sin_addr.s_addr == address.sin_addr.s_addr)
+                return &player;
+        auto observer = observer_endpoints.find(get_endpoint_key(address));
+        return observer == observer_endpoints.end() ? nullptr : &observers[observer->second];
+    }
+
+    /* Players and observers have their own limits */
+    void add_client(ClientData client) {
+        if (client.player_name.empty()) {
+            if (observers.size() >= observers_max_number)
+                return; /* Observer limit */
+            observer_endpoints[get_endpoint_key(client.client_address)] = observers.size();
+            observer_sessions.insert(client.session_id);
+            observers.push_back(std::move(client));
+            ingress_filter.add_endpoint(observers.back().client_address, get_time());
+            return;
+        }
+        if (players.size() >= clients_max_number)
+            return; /* Client limit */
+        players.push_back(std::move(client));
+        ingress_filter.add_endpoint(players.back().client_address, get_time());
+    }
+
+    void remove_client(const struct sockaddr_in& address) {
+        auto observer = observer_endpoints.find(get_endpoint_key(address));
+        if (observer != observer_endpoints.end()) {
+            remove_observer(observer->second);
+            return;
+        }
+        for (auto player = players.begin(); player != players.end(); ++player) {
+            if (player->client_address.sin_port == address.sin_port &&
+                player->client_address.sin_addr.s_addr == address.sin_addr.s_addr) {
+                ingress_filter.remove_endpoint(player->client_address);
+                players.erase(player);
+                return;
+            }
+        }
+    }
+
+    /* Last observer takes its place, order of observers doesn't matter */
+    void remove_observer(uint32_t index) {
+        ingress_filter.remove_endpoint(observers[index].client_address);
+        observer_endpoints.erase(get_endpoint_key(observers[index].client_address));
+        observer_sessions.erase(observers[index].session_id);
+        if (index + 1 != observers.size()) {
+            observers[index] = std::move(observers.back());
+            observer_endpoints[get_endpoint_key(observers[index].client_address)] = index;
+        }
+        observers.pop_back();
+    }
+
+    void save_client(HandoffWriter& writer, const ClientData& client) const {
+        writer.put(client.session_id);
+        writer.put(client.last_message_time);
+        writer.put_string(client.player_name);
+        writer.put(client.want_to_play);
+        writer.put(client.client_address.sin_addr.s_addr);
+        writer.put(client.client_address.sin_port);
+        writer.put(client.last_turn_direction);
+        writer.put(client.player_number);
+        writer.put(client.datagram_size);
+    }
+
+    /* Fills observer_datagrams with datagrams of events from event_no, one after another */
+    template<typename EventLog>
+    void pack_observer_datagrams(const EventLog& events, uint32_t event_no,
+                                 uint32_t game_id, uint16_t datagram_size) {
+        observer_datagram_ends.clear();
+        uint32_t pos = 0, start = 0;
+        for (; event_no < events.size(); ++event_no) {
+            if (observer_datagrams.size() < pos + 4 + get_record_length(events, event_no))
+                observer_datagrams.resize(2 * (pos + 4 + get_record_length(events, event_no)));
+            if (pos == start) {
+                *(uint32_t*)(observer_datagrams.data() + pos) = htonl(game_id);
+                pos += 4;
+            }
+            if (pos - start + get_record_length(events, event_no) > datagram_size &&
+                pos - start > 4) {
+                /* New event cannot be added, next datagram */
+                observer_datagram_ends.push_back(pos);
+                start = pos;
+                event_no -= 1; // To pack this event again
+                continue;
+            }
+            pos += serialize_record(events, event_no, observer_datagrams.data() + pos);
+        }
+        observer_datagram_ends.push_back(pos);
+    }
+
+    /* Datagram waits in batch for sendmmsg, or goes the usual way when it can't */
+    void add_to_observer_batch(const uint8_t* datagram, uint16_t datagram_len,
+                               const struct sockaddr_in* client_address_ptr) {
+        if (uring.is_active() || !send_queue.is_empty()) {
+            send_datagram(datagram, datagram_len, client_address_ptr);
+            return;
+        }
+        observer_iovs[observer_batch_size] = {(void*) datagram, datagram_len};
+        struct msghdr& msg = observer_msgs[observer_batch_size].msg_hdr;
+        msg = {};
+        msg.msg_name = (void*) client_address_ptr;
+        msg.msg_namelen = sizeof(*client_address_ptr);
+        msg.msg_iov = &observer_iovs[observer_batch_size];
+        msg.msg_iovlen = 1;
+        if (++observer_batch_size == OBSERVER_SEND_BATCH)
+            flush_observer_batch();
+    }
+
+    /* Datagrams refused by full socket go to send queue in order */
+    void flush_observer_batch() {
+        uint32_t sent = 0;
+        while (sent < observer_batch_size) {
+            TRACE_PROBE(send_start, observer_batch_size - sent);
+            int result = sendmmsg(sock, observer_msgs.data() + sent,
+                                  observer_batch_size - sent, 0);
+            TRACE_PROBE(send_end, result);
+            if (result > 0) {
+                sent += result;
+                continue;
+            }
+            if (is_socket_full())
+                break;
+            // Just report error, no need to stop program
+            const auto* address = (const struct sockaddr_in*) observer_msgs[sent].msg_hdr.msg_name;
+            std::cerr << "Sending buffer to " << address->sin_addr.s_addr
+                      << ":" << address->sin_port << " failed!" << std::endl;
+            sent++;
+        }
+        for (; sent < observer_batch_size; ++sent)
+            send_queue.push((const uint8_t*) observer_iovs[sent].iov_base,
+                            observer_iovs[sent].iov_len,
+                            (const struct sockaddr_in*) observer_msgs[sent].msg_hdr.msg_name);
+        observer_batch_size = 0;
+    }
+
     uint8_t receive_message() {
         auto rcva_len = (socklen_t) sizeof(client_address);
-        ssize_t len = recvfrom(sock, buffer_r, sizeof(buffer_r), 0,
-                               (struct sockaddr *) &client_address, &rcva_len);
+        ssize_t len = uring.is_active()
+                      ? uring.receive(buffer_r, sizeof(buffer_r), &client_address)
+                      : recvfrom(sock, buffer_r, sizeof(buffer_r), MSG_TRUNC,
+                                 (struct sockaddr *) &client_address, &rcva_len);
         if (len == -1)
             return EMPTY; // Empty message
-        if (len < 13)
-            return EMPTY; // Invalid message
+        TRACE_PROBE(receive, len);
+        if (!ingress_filter.accept(buffer_r, len, client_address, get_time()))
+            return EMPTY; // Invalid message or sender over its limit
 
         session_id = be64toh(*(uint64_t*)buffer_r);
         turn_direction = buffer_r[8];
         next_expected_event_no = ntohl(*(uint32_t*)(buffer_r + 9));
         player_name.clear();
-        for (int i = 13; i < len; ++i)
+        int i = 13;
+        for (; i < len && buffer_r[i] != '\0'; ++i)
             player_name.push_back(buffer_r[i]);
-
-        if (turn_direction > LEFT)
-            return EMPTY;
+        if (clients_max_number == 0)
+            player_name.clear(); // Nobody plays here (relay), clients with names only watch
+
+        /* Optional extension, '\0' and size of datagrams client can receive */
+        datagram_size = MAX_SERVER_DATAGRAM_SIZE;
+        if (len - i == (ssize_t) CLIENT_EXTENSION_SIZE)
+            datagram_size = std::clamp<uint16_t>(ntohs(*(uint16_t*)(buffer_r + i + 1)),
+                                                 MAX_SERVER_DATAGRAM_SIZE,
+                                                 MAX_UDP_PAYLOAD_SIZE);
         return RECEIVED;
     }
 
@@ -222,45 +621,154 @@ private:
         add_uint32_to_buffer(game_id);
     }
 
-    void add_event_to_buffer(const Event& event) {
-        uint32_t event_pos = buffer_pos;
-        add_uint32_to_buffer(event.get_length());
-        add_uint32_to_buffer(event.event_no);
-        add_byte_to_buffer(event.event_type);
-
-        switch (event.event_type) {
-            case NEW_GAME: {
-                add_uint32_to_buffer(event.x);
-                add_uint32_to_buffer(event.y);
-                for (const auto &name : event.player_names)
-                    add_string_to_buffer(name);
-                break;
-            }
-            case PIXEL: {
-                add_byte_to_buffer(event.player_number);
-                add_uint32_to_buffer(event.x);
-                add_uint32_to_buffer(event.y);
-                break;
-            }
-            case PLAYER_ELIMINATED: {
-                add_byte_to_buffer(event.player_number);
-                break;
-            }
+    void send_and_clear_buffer(const struct sockaddr_in* client_address_ptr) {
+        if (gso_batching) {
+            add_buffer_to_gso_batch(client_address_ptr);
+            buffer_pos = 0;
+            return;
         }
-
-        add_uint32_to_buffer(generate_crc32(buffer_w + event_pos,
-                                            event.get_length() + 4));
+        send_datagram(buffer_w.data(), buffer_pos, client_address_ptr);
+        buffer_pos = 0;
     }
 
-    void send_and_clear_buffer(const struct sockaddr_in* client_address_ptr) {
+    void send_datagram(const uint8_t* datagram, uint16_t datagram_len,
+                       const struct sockaddr_in* client_address_ptr) {
+        if (uring.is_active()) {
+            if (!uring.send(datagram, datagram_len, client_address_ptr))
+                std::cerr << "Queueing datagram to " << client_address_ptr->sin_addr.s_addr
+                          << ":" << client_address_ptr->sin_port << " in io_uring failed!" << std::endl;
+            return;
+        }
+        if (!send_queue.is_empty()) {
+            /* Older datagrams are still waiting, keep the order */
+            send_queue.push(datagram, datagram_len, client_address_ptr);
+            return;
+        }
         ssize_t snd_len = (socklen_t) sizeof(*client_address_ptr);
-        if (sendto(sock, buffer_w, (size_t) buffer_pos, 0,
-                   (struct sockaddr*) client_address_ptr, snd_len) != buffer_pos) {
+        TRACE_PROBE(send_start, datagram_len);
+        ssize_t sent = sendto(sock, datagram, (size_t) datagram_len, 0,
+                              (struct sockaddr*) client_address_ptr, snd_len);
+        TRACE_PROBE(send_end, datagram_len);
+        if (sent != datagram_len) {
+            if (is_socket_full()) {
+                send_queue.push(datagram, datagram_len, client_address_ptr);
+                return;
+            }
             // Just report error, no need to stop program
             std::cerr << "Sending buffer to " << client_address_ptr->sin_addr.s_addr
                       << ":" << client_address_ptr->sin_port << " failed!" << std::endl;
         }
-        buffer_pos = 0;
+    }
+
+    /* Sends queued datagrams until socket refuses one again */
+    void flush_send_queue() {
+        while (!send_queue.is_empty()) {
+            const auto& queued = send_queue.front();
+            if (sendto(sock, queued.data.data(), queued.data.size(), 0,
+                       (struct sockaddr*) &queued.address, (socklen_t) sizeof(queued.address))
+                != (ssize_t) queued.data.size()) {
+                if (is_socket_full())
+                    return;
+                send_queue.dropped++; // Failed for good
+            }
+            send_queue.pop();
+        }
+    }
+
+    static bool is_socket_full() {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS;
+    }
+
+    bool is_socket_writable() {
+        if (writable_epoll < 0) {
+            writable_epoll = epoll_create1(EPOLL_CLOEXEC);
+            struct epoll_event event{};
+            event.events = EPOLLOUT;
+            if (writable_epoll < 0 || epoll_ctl(writable_epoll, EPOLL_CTL_ADD, sock, &event) < 0)
+                report_fail("Epoll initialization failed!");
+        }
+        struct epoll_event event{};
+        return epoll_wait(writable_epoll, &event, 1, 0) > 0;
+    }
+
+    /*
+     * Kernel splits GSO buffer into segments of equal size, only the last one
+     * can be shorter. Datagram which doesn't fit these rules starts new batch.
+     */
+    void add_buffer_to_gso_batch(const struct sockaddr_in* client_address_ptr) {
+        if (gso_segments > 0 &&
+            (buffer_pos > gso_segment_size || gso_segments == GSO_MAX_SEGMENTS ||
+             gso_buffer_pos != gso_segments * gso_segment_size ||
+             gso_buffer_pos + buffer_pos > sizeof(gso_buffer)))
+            flush_gso_batch();
+
+        if (gso_segments == 0)
+            gso_segment_size = buffer_pos;
+        memcpy(gso_buffer + gso_buffer_pos, buffer_w.data(), buffer_pos);
+        gso_buffer_pos += buffer_pos;
+        gso_segments++;
+        gso_address = client_address_ptr;
+    }
+
+    void flush_gso_batch() {
+        if (gso_segments == 0)
+            return;
+        if (gso_segments == 1 || !send_gso_batch())
+            send_gso_batch_separately();
+        gso_buffer_pos = 0;
+        gso_segments = 0;
+    }
+
+    /* Returns false when segments have to be sent or queued one by one */
+    bool send_gso_batch() {
+        if (!send_queue.is_empty())
+            return false; // Segments go to the queue behind older datagrams
+#ifdef UDP_SEGMENT
+        struct iovec iov{gso_buffer, gso_buffer_pos};
+        char control[CMSG_SPACE(sizeof(uint16_t))]{};
+        struct msghdr msg{};
+        msg.msg_name = (void*) gso_address;
+        msg.msg_namelen = sizeof(*gso_address);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        *(uint16_t*) CMSG_DATA(cmsg) = gso_segment_size;
+
+        TRACE_PROBE(send_start, gso_buffer_pos);
+        ssize_t sent = sendmsg(sock, &msg, 0);
+        TRACE_PROBE(send_end, gso_buffer_pos);
+        if (sent == gso_buffer_pos)
+            return true;
+        if (is_socket_full())
+            return false; // Offload works, socket is just full, segments are queued
+        if (gso_segment_size > MAX_SERVER_DATAGRAM_SIZE)
+            return false; // Segments may be over path MTU, offload still works for others
+        gso_enabled = false; // Device or kernel can't segment, use plain loop
+#endif
+        return false;
+    }
+
+    void send_gso_batch_separately() {
+        for (uint32_t pos = 0; pos < gso_buffer_pos; pos += gso_segment_size)
+            send_datagram(gso_buffer + pos,
+                          std::min<uint32_t>(gso_segment_size, gso_buffer_pos - pos),
+                          gso_address);
+    }
+
+    bool is_gso_supported() const {
+#ifdef UDP_SEGMENT
+        int val;
+        socklen_t val_len = sizeof(val);
+        return getsockopt(sock, SOL_UDP, UDP_SEGMENT, &val, &val_len) == 0;
+#else
+        return false;
+#endif
     }
 
     void init_socket() {
@@ -287,17 +795,6 @@ private:
         buffer_pos += sizeof(val);
     }
 
-    void add_byte_to_buffer(uint8_t val) {
-        buffer_w[buffer_pos] = val;
-        buffer_pos += sizeof(val);
-    }
-
-    void add_string_to_buffer(const std::string& val) {
-        for (char c : val)
-            add_byte_to_buffer(c);
-        add_byte_to_buffer('\0');
-    }
-
     static void report_fail(const char* message) {
         std::cerr << message << std::endl;
         exit(1);
@@ -0,0 +1,219 @@
+#ifndef PROJEKT2_SERVER_HANDOFF_H
+#define PROJEKT2_SERVER_HANDOFF_H
+
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+const uint32_t HANDOFF_MAGIC = 0x48575753; // "SWWH"
+const uint32_t HANDOFF_VERSION = 3;
+
+/* Builds state of the server in flat form, integers in host byte order */
+class HandoffWriter {
+
+public:
+    std::vector<uint8_t> data;
+
+    void put_bytes(const void* ptr, size_t size) {
+        data.insert(data.end(), (const uint8_t*) ptr, (const uint8_t*) ptr + size);
+    }
+
+    template<typename T>
+    void put(T val) {
+        put_bytes(&val, sizeof(val));
+    }
+
+    void put_string(const std::string& val) {
+        put<uint32_t>(val.size());
+        put_bytes(val.data(), val.size());
+    }
+
+};
+
+class HandoffReader {
+
+    const uint8_t* data;
+    size_t size;
+    size_t pos = 0;
+
+public:
+    HandoffReader(const uint8_t* data, size_t size): data(data), size(size) {}
+
+    const uint8_t* get_bytes(size_t len) {
+        if (pos + len > size)
+            report_fail("Handed off state is truncated!");
+        pos += len;
+        return data + pos - len;
+    }
+
+    template<typename T>
+    T get() {
+        T val;
+        memcpy(&val, get_bytes(sizeof(val)), sizeof(val));
+        return val;
+    }
+
+    std::string get_string() {
+        auto len = get<uint32_t>();
+        return std::string((const char*) get_bytes(len), len);
+    }
+
+private:
+    static void report_fail(const char* message) {
+        std::cerr << message << std::endl;
+        exit(1);
+    }
+
+};
+
+/*
+ * Passing bound game socket and state between old and new server process.
+ * New process connects to Unix socket of the old one, old process writes its
+ * state to memfd and sends both descriptors with SCM_RIGHTS. Datagrams which
+ * arrive in the meantime wait in the game socket.
+ */
+class ServerHandoff {
+
+    const std::string path;
+    int listen_sock = -1;
+    int request_sock = -1;
+
+public:
+
+    explicit ServerHandoff(std::string path): path(std::move(path)) {}
+
+    bool is_enabled() const {
+        return !path.empty();
+    }
+
+    /*
+     * Takes over from server listening on path. Returns false if there is
+     * no such server.
+     */
+    bool receive(int& game_sock, std::vector<uint8_t>& state) {
+        if (!is_enabled())
+            return false;
+
+        int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un address = get_address();
+        if (connect(sock, (struct sockaddr*) &address, sizeof(address)) < 0) {
+            close(sock);
+            return false; // Nobody to take over from
+        }
+
+        int fds[2];
+        uint8_t ok;
+        struct iovec iov{&ok, sizeof(ok)};
+        char control[CMSG_SPACE(sizeof(fds))]{};
+        struct msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(sock, &msg, 0) != sizeof(ok))
+            report_fail("Receiving handed off server failed!");
+        close(sock);
+
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        if (cmsg == nullptr || cmsg->cmsg_type != SCM_RIGHTS ||
+            cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+            report_fail("Handed off descriptors missing!");
+        memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+        game_sock = fds[0];
+
+        /* Copy state out of shared memory */
+        uint64_t header[2];
+        if (pread(fds[1], header, sizeof(header), 0) != sizeof(header) ||
+            header[0] != ((uint64_t) HANDOFF_VERSION << 32 | HANDOFF_MAGIC))
+            report_fail("Handed off state unknown!");
+        void* ptr = mmap(nullptr, sizeof(header) + header[1], PROT_READ, MAP_SHARED, fds[1], 0);
+        if (ptr == MAP_FAILED)
+            report_fail("Mapping handed off state failed!");
+        state.assign((uint8_t*) ptr + sizeof(header),
+                     (uint8_t*) ptr + sizeof(header) + header[1]);
+        munmap(ptr, sizeof(header) + header[1]);
+        close(fds[1]);
+        return true;
+    }
+
+    /* Starts waiting for the next server process */
+    void listen_for_successor() {
+        if (!is_enabled())
+            return;
+
+        unlink(path.c_str());
+        listen_sock = socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un address = get_address();
+        if (bind(listen_sock, (struct sockaddr*) &address, sizeof(address)) < 0 ||
+            listen(listen_sock, 1) < 0)
+            report_fail("Listening for server upgrade failed!");
+        fcntl(listen_sock, F_SETFL, O_NONBLOCK);
+    }
+
+    /* Checks whether next server process is waiting for our state */
+    bool is_requested() {
+        if (listen_sock < 0)
+            return false;
+        if (request_sock < 0)
+            request_sock = accept(listen_sock, nullptr, nullptr);
+        return request_sock >= 0;
+    }
+
+    void send(int game_sock, const std::vector<uint8_t>& state) {
+        uint64_t header[2] = {(uint64_t) HANDOFF_VERSION << 32 | HANDOFF_MAGIC, state.size()};
+        int memfd = memfd_create("screen-worms-handoff", 0);
+        if (memfd < 0 || ftruncate(memfd, sizeof(header) + state.size()) < 0)
+            report_fail("Creating handoff memory failed!");
+        void* ptr = mmap(nullptr, sizeof(header) + state.size(), PROT_WRITE, MAP_SHARED, memfd, 0);
+        if (ptr == MAP_FAILED)
+            report_fail("Mapping handoff memory failed!");
+        memcpy(ptr, header, sizeof(header));
+        memcpy((uint8_t*) ptr + sizeof(header), state.data(), state.size());
+        munmap(ptr, sizeof(header) + state.size());
+
+        int fds[2] = {game_sock, memfd};
+        uint8_t ok = 1;
+        struct iovec iov{&ok, sizeof(ok)};
+        char control[CMSG_SPACE(sizeof(fds))]{};
+        struct msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+        fcntl(request_sock, F_SETFL, 0);
+        if (sendmsg(request_sock, &msg, 0) != sizeof(ok))
+            report_fail("Handing off server failed!");
+        close(request_sock);
+        close(memfd);
+    }
+
+private:
+    struct sockaddr_un get_address() const {
+        struct sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path))
+            report_fail("Upgrade socket path too long!");
+        strcpy(address.sun_path, path.c_str());
+        return address;
+    }
+
+    static void report_fail(const char* message) {
+        std::cerr << message << std::endl;
+        exit(1);
+    }
+
+};
+
+#endif //PROJEKT2_SERVER_HANDOFF_H
@@ -6,6 +6,7 @@
 #include <ctime>
 
 #include "consts.h"
+#include "multicast.h"
 
 
 class ServerOptions {
@@ -17,12 +18,22 @@ public:
     uint16_t rounds_per_sec = DEFAULT_ROUNDS_PER_SEC;
     uint32_t screen_width = DEFAULT_SCREEN_WIDTH;
     uint32_t screen_height = DEFAULT_SCREEN_HEIGHT;
+    bool use_io_uring = false;
+    std::string record_directory{};
+    std::string replay_path{};
+    uint16_t replay_speed = 1;
+    std::string upgrade_path{};
+    bool trace = false;
+    std::string trace_dump_path{}; // Empty when trace ring is disabled
+    bool split_threads = false;
+    MulticastGroup multicast_group; // Of observers, disabled by default
+    uint32_t observers_max_number = DEFAULT_OBSERVERS_MAX_NUMBER;
 
     ServerOptions(int argc, char* argv[]) {
         int64_t helpy;
         int opt;
 
-        while ((opt = getopt(argc, argv, "p:s:t:v:w:h:")) != -1) {
+        while ((opt = getopt(argc, argv, "p:s:t:v:w:h:ur:R:x:H:TP:SM:O:")) != -1) {
             switch (opt) {
                 case 'p':
                     helpy = strtol(optarg, nullptr, 10);
@@ -60,6 +71,43 @@ public:
                         fail_constructor("Screen width invalid!");
                     screen_height = helpy;
                     break;
+                case 'u':
+                    use_io_uring = true;
+                    break;
+                case 'r':
+                    record_directory = optarg;
+                    break;
+                case 'R':
+                    replay_path = optarg;
+                    break;
+                case 'x':
+                    helpy = strtol(optarg, nullptr, 10);
+                    if (helpy <= 0 || helpy > MAX_REPLAY_SPEED)
+                        fail_constructor("Replay speed invalid!");
+                    replay_speed = helpy;
+                    break;
+                case 'H':
+                    upgrade_path = optarg;
+                    break;
+                case 'T':
+                    trace = true;
+                    break;
+                case 'P':
+                    trace_dump_path = optarg;
+                    break;
+                case 'S':
+                    split_threads = true;
+                    break;
+                case 'M':
+                    if (!multicast_group.parse(optarg))
+                        fail_constructor("Multicast group invalid!");
+                    break;
+                case 'O':
+                    helpy = strtol(optarg, nullptr, 10);
+                    if (helpy < 0 || helpy > MAX_OBSERVERS_NUMBER)
+                        fail_constructor("Observers number invalid!");
+                    observers_max_number = helpy;
+                    break;
                 default:
                     fail_constructor("Unrecognized program option!");
             }
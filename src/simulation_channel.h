@@ -0,0 +1,52 @@
+#ifndef PROJEKT2_SIMULATION_CHANNEL_H
+#define PROJEKT2_SIMULATION_CHANNEL_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "consts.h"
+#include "events.h"
+#include "spsc_queue.h"
+
+/* Published after events of every round, round 0 is start of new game */
+class RoundEnd {
+
+public:
+    uint32_t game_id;
+    uint32_t round_no;
+    uint32_t events_number; // Already waiting in events queue
+    bool game_rolling;
+    uint64_t round_time; // When computation of round started
+
+};
+
+/*
+ * Handoff between simulation thread, which owns GameState and round timing,
+ * and network thread, which owns the socket. Simulation publishes copies of
+ * new events of every round, network thread keeps its own event log for
+ * sending, catch-ups and recording. Turn directions are read by simulation
+ * at the start of round, their latest values are enough.
+ */
+class SimulationChannel {
+
+public:
+    /* Simulation to network */
+    SpscQueue<Event> events{SIMULATION_EVENTS_CAPACITY};
+    SpscQueue<RoundEnd> rounds{SIMULATION_ROUNDS_CAPACITY};
+    std::atomic<bool> slow_round{false}; // Round computed longer than its length
+    std::atomic<bool> stopped{false};
+
+    /* Network to simulation */
+    SpscQueue<std::vector<std::string>> game_starts{4}; // Names of players
+    std::atomic<uint8_t> turn_directions[CLIENTS_MAX_NUMBER]{};
+    std::atomic<bool> stopping{false};
+
+    SimulationChannel() {
+        for (auto& turn_direction : turn_directions)
+            turn_direction.store(NO_CHANGES, std::memory_order_relaxed);
+    }
+
+};
+
+#endif //PROJEKT2_SIMULATION_CHANNEL_H
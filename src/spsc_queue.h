@@ -0,0 +1,56 @@
+#ifndef PROJEKT2_SPSC_QUEUE_H
+#define PROJEKT2_SPSC_QUEUE_H
+
+#include <atomic>
+#include <optional>
+#include <utility>
+#include <vector>
+
+/*
+ * Bounded lock-free queue of one producer and one consumer thread. Values
+ * are constructed in place and read through front, so they don't need to be
+ * assignable. Capacity has to be a power of 2.
+ */
+template<typename T>
+class SpscQueue {
+
+    std::vector<std::optional<T>> slots;
+    const uint64_t mask;
+    alignas(64) std::atomic<uint64_t> head{}; // Written by consumer
+    alignas(64) std::atomic<uint64_t> tail{}; // Written by producer
+
+public:
+    explicit SpscQueue(uint32_t capacity) : slots(capacity), mask(capacity - 1) {}
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    /* Producer only, returns false when queue is full */
+    template<typename... Args>
+    bool push(Args&&... args) {
+        uint64_t pos = tail.load(std::memory_order_relaxed);
+        if (pos - head.load(std::memory_order_acquire) == slots.size())
+            return false;
+        slots[pos & mask].emplace(std::forward<Args>(args)...);
+        tail.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* Consumer only, nullptr when queue is empty */
+    T* front() {
+        uint64_t pos = head.load(std::memory_order_relaxed);
+        if (pos == tail.load(std::memory_order_acquire))
+            return nullptr;
+        return &*slots[pos & mask];
+    }
+
+    /* Consumer only, queue can't be empty */
+    void pop() {
+        uint64_t pos = head.load(std::memory_order_relaxed);
+        slots[pos & mask].reset();
+        head.store(pos + 1, std::memory_order_release);
+    }
+
+};
+
+#endif //PROJEKT2_SPSC_QUEUE_H
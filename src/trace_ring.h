@@ -0,0 +1,177 @@
+#ifndef PROJEKT2_TRACE_RING_H
+#define PROJEKT2_TRACE_RING_H
+
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "utils.h"
+
+/*
+ * Probes at stages of server and client loops. Every probe is a static
+ * tracepoint of provider screen_worms (for perf and bpftrace, when built
+ * with sys/sdt.h) and, when enabled, entry in trace ring of calling thread.
+ * Rings keep the last TRACE_RING_CAPACITY entries and are dumped to a text
+ * file on demand. Building with -DNO_TRACE_PROBES removes probes entirely.
+ */
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>) && !defined(NO_TRACE_PROBES)
+#include <sys/sdt.h>
+#define TRACE_SDT(name, arg) DTRACE_PROBE1(screen_worms, name, arg)
+#endif
+#endif
+#ifndef TRACE_SDT
+#define TRACE_SDT(name, arg) do {} while (false)
+#endif
+
+#ifdef NO_TRACE_PROBES
+#define TRACE_PROBE(name, arg) do {} while (false)
+#else
+#define TRACE_PROBE(name, arg) do { \
+        TRACE_SDT(name, arg); \
+        if (TraceRing::enabled) \
+            TraceRing::local().record(TraceProbe::name, (uint32_t) (arg)); \
+    } while (false)
+#endif
+
+/* Names of probes are used by the macro, start and end pairs mark stages */
+enum class TraceProbe : uint16_t {
+    receive,                // Server got datagram, arg is its length
+    round_start,            // Arg is round number
+    round_end,
+    send_events_start,      // Serialization with CRC and sending to one client, arg is first event
+    send_events_end,        // Arg is number of events
+    send_start,             // sendto or sendmsg, arg is number of bytes
+    send_end,
+    client_receive,         // Client got datagram, arg is its length
+    client_events_end,      // Events of datagram passed to interface, arg is next expected event
+    client_send,            // Client messaged server, arg is turn direction
+};
+
+const char* const TRACE_PROBE_NAMES[] = {
+        "receive", "round_start", "round_end", "send_events_start", "send_events_end",
+        "send_start", "send_end", "client_receive", "client_events_end", "client_send"
+};
+
+const uint32_t TRACE_RING_CAPACITY = 1 << 14; // Power of 2
+
+class TraceRing {
+
+    class Entry {
+
+    public:
+        uint64_t ticks;
+        uint32_t arg;
+        uint16_t probe;
+        uint16_t thread;
+
+    };
+
+    Entry entries[TRACE_RING_CAPACITY]{};
+    std::atomic<uint64_t> position{};
+    uint16_t thread;
+
+    /* Rings of every thread which recorded anything, never freed */
+    static std::mutex& get_rings_mutex() {
+        static std::mutex rings_mutex;
+        return rings_mutex;
+    }
+
+    static std::vector<std::unique_ptr<TraceRing>>& get_rings() {
+        static std::vector<std::unique_ptr<TraceRing>> rings;
+        return rings;
+    }
+
+    /* Clocks when tracing was enabled, to convert ticks to microseconds */
+    inline static uint64_t start_ticks{}, start_time{};
+
+    explicit TraceRing(uint16_t thread) : thread(thread) {}
+
+public:
+    inline static bool enabled = false;
+    inline static volatile std::sig_atomic_t dump_requested = 0;
+
+    static void enable() {
+        start_ticks = get_ticks();
+        start_time = get_time();
+        enabled = true;
+    }
+
+    /* SIGUSR1 sets dump_requested, loops check it with is_dump_requested */
+    static void dump_on_signal() {
+        signal(SIGUSR1, [](int) { dump_requested = 1; });
+    }
+
+    static bool is_dump_requested() {
+        if (!dump_requested)
+            return false;
+        dump_requested = 0;
+        return true;
+    }
+
+    static TraceRing& local() {
+        static thread_local TraceRing* ring = nullptr;
+        if (ring == nullptr) {
+            std::lock_guard<std::mutex> lock(get_rings_mutex());
+            auto& rings = get_rings();
+            rings.emplace_back(new TraceRing(rings.size()));
+            ring = rings.back().get();
+        }
+        return *ring;
+    }
+
+    void record(TraceProbe probe, uint32_t arg) {
+        uint64_t pos = position.load(std::memory_order_relaxed);
+        entries[pos & (TRACE_RING_CAPACITY - 1)] = {get_ticks(), arg, (uint16_t) probe, thread};
+        position.store(pos + 1, std::memory_order_release);
+    }
+
+    /*
+     * Writes entries of all rings ordered by time, one per line: time in
+     * microseconds since epoch, thread, probe and argument. Entries recorded
+     * by other threads during the dump may be torn.
+     */
+    static bool dump(const std::string& path) {
+        double ticks_per_us = (double) (get_ticks() - start_ticks) /
+                              std::max<uint64_t>(get_time() - start_time, 1);
+        std::vector<Entry> all;
+        {
+            std::lock_guard<std::mutex> lock(get_rings_mutex());
+            for (const auto& ring : get_rings()) {
+                uint64_t end = ring->position.load(std::memory_order_acquire);
+                uint64_t begin = end > TRACE_RING_CAPACITY ? end - TRACE_RING_CAPACITY : 0;
+                for (uint64_t pos = begin; pos < end; ++pos)
+                    all.push_back(ring->entries[pos & (TRACE_RING_CAPACITY - 1)]);
+            }
+        }
+        std::sort(all.begin(), all.end(),
+                  [](const Entry& a, const Entry& b) { return a.ticks < b.ticks; });
+
+        std::ofstream file(path, std::ios::trunc);
+        for (const auto& entry : all)
+            file << start_time + (uint64_t) ((entry.ticks - start_ticks) / ticks_per_us) << " "
+                 << entry.thread << " " << TRACE_PROBE_NAMES[entry.probe] << " "
+                 << entry.arg << "\n";
+        return file.good();
+    }
+
+private:
+    /* Time stamp counter where available, it's a few times cheaper than clock */
+    static uint64_t get_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __builtin_ia32_rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>
+                (std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+};
+
+#endif //PROJEKT2_TRACE_RING_H
@@ -0,0 +1,418 @@
+#ifndef PROJEKT2_URING_SOCKET_H
+#define PROJEKT2_URING_SOCKET_H
+
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <deque>
+
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define PROJEKT2_HAVE_IO_URING
+#endif
+
+#include "consts.h"
+
+/*
+ * io_uring backend of the server socket. Receiving is done by one multishot
+ * recvmsg writing into ring of provided buffers, so no syscall is needed while
+ * datagrams are arriving. Outgoing datagrams are only queued, they are all
+ * submitted with one io_uring_enter call in submit(). Multishot recvmsg needs
+ * Linux 6.0, on 5.19 the ring is set up but the receive fails at once, so
+ * init() checks its first completion.
+ */
+class UringSocket {
+
+#ifdef PROJEKT2_HAVE_IO_URING
+    class SendSlot {
+
+    public:
+        std::vector<uint8_t> data; // Grows only for datagrams of negotiated size
+        struct sockaddr_in address;
+        struct iovec iov;
+        struct msghdr msg;
+
+    };
+
+    static const uint32_t RING_ENTRIES = 1024;
+    static const uint16_t RECV_BUFFERS = 256; // Power of 2
+    static const uint32_t RECV_BUFFER_SIZE = 128;
+    static const uint16_t RECV_BUFFER_GROUP = 0;
+    static const uint64_t RECV_USER_DATA = ~0ULL;
+    static const uint64_t CANCEL_USER_DATA = ~0ULL - 1;
+
+    int ring_fd = -1;
+    int sock = -1;
+
+    /* Submission queue */
+    void* sq_ring_ptr = nullptr;
+    size_t sq_ring_size{};
+    struct io_uring_sqe* sqes = nullptr;
+    uint32_t *sq_tail{}, *sq_head{}, *sq_array{};
+    uint32_t sq_mask{}, sq_entries{};
+    uint32_t sq_local_tail{};
+    uint32_t to_submit = 0;
+
+    /* Completion queue */
+    uint32_t *cq_head{}, *cq_tail{};
+    uint32_t cq_mask{};
+    struct io_uring_cqe* cqes = nullptr;
+
+    /* Provided buffers for multishot receive */
+    struct io_uring_buf_ring* buf_ring = nullptr;
+    size_t buf_ring_size{};
+    std::vector<uint8_t> recv_buffers;
+    struct msghdr recv_msg{};
+
+    /* Preallocated outgoing datagrams */
+    std::vector<SendSlot> send_slots;
+    std::vector<uint32_t> free_send_slots;
+
+    /* Receive completions not yet handed to the caller */
+    std::deque<struct io_uring_cqe> received;
+    bool receiving = true;
+    bool receive_stopped = false;
+#endif
+
+public:
+
+    UringSocket() = default;
+    UringSocket(const UringSocket&) = delete;
+    UringSocket& operator=(const UringSocket&) = delete;
+
+    ~UringSocket() {
+#ifdef PROJEKT2_HAVE_IO_URING
+        if (ring_fd >= 0)
+            close(ring_fd);
+        if (sq_ring_ptr != nullptr)
+            munmap(sq_ring_ptr, sq_ring_size);
+        if (sqes != nullptr)
+            munmap(sqes, RING_ENTRIES * sizeof(struct io_uring_sqe));
+        if (buf_ring != nullptr)
+            munmap(buf_ring, buf_ring_size);
+#endif
+    }
+
+    /* Returns false when kernel doesn't support everything that is needed */
+    bool init(int sock_arg) {
+#ifdef PROJEKT2_HAVE_IO_URING
+        sock = sock_arg;
+        if (!init_ring() || !init_buffer_ring())
+            return false;
+
+        send_slots.resize(RING_ENTRIES);
+        for (uint32_t i = 0; i < RING_ENTRIES; ++i) {
+            send_slots[i].data.reserve(MAX_SERVER_DATAGRAM_SIZE);
+            free_send_slots.push_back(i);
+        }
+
+        if (!arm_receive() || !submit())
+            return fail_init();
+
+        /* Unsupported receive completes during submission, armed one waits */
+        reap_completions();
+        for (const auto& cqe : received) {
+            if (cqe.res == -EINVAL) {
+                received.clear();
+                return fail_init(); // Kernel older than 6.0
+            }
+        }
+        return true;
+#else
+        (void) sock_arg;
+        return false;
+#endif
+    }
+
+    bool is_active() const {
+#ifdef PROJEKT2_HAVE_IO_URING
+        return ring_fd >= 0;
+#else
+        return false;
+#endif
+    }
+
+    /*
+     * Returns length of the next received datagram, -1 if there is none.
+     * Like recvfrom with MSG_TRUNC, length may be bigger than size.
+     * Completions of sends found on the way are reaped as well.
+     */
+    ssize_t receive(uint8_t* buffer, size_t size, struct sockaddr_in* address) {
+#ifdef PROJEKT2_HAVE_IO_URING
+        if (received.empty())
+            reap_completions();
+
+        while (!received.empty()) {
+            struct io_uring_cqe cqe = received.front();
+            received.pop_front();
+
+            if (!(cqe.flags & IORING_CQE_F_MORE) && receiving) {
+                /* Multishot receive stopped (e.g. out of buffers), post it again */
+                if (cqe.res == -EINVAL || !arm_receive() || !submit()) {
+                    std::cerr << "Receiving with io_uring stopped!" << std::endl;
+                    receiving = false;
+                }
+            }
+            if (cqe.res < 0 || !(cqe.flags & IORING_CQE_F_BUFFER))
+                continue;
+
+            uint16_t buffer_id = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+            uint8_t* recv_buffer = recv_buffers.data() + buffer_id * RECV_BUFFER_SIZE;
+            auto out = (struct io_uring_recvmsg_out*) recv_buffer;
+            uint8_t* payload = recv_buffer + sizeof(*out) + recv_msg.msg_namelen;
+
+            size_t len = std::min<size_t>(std::min<size_t>(out->payloadlen, size),
+                                          RECV_BUFFER_SIZE - (payload - recv_buffer));
+            memcpy(buffer, payload, len);
+            memcpy(address, recv_buffer + sizeof(*out), sizeof(*address));
+            recycle_buffer(buffer_id);
+            return std::max<size_t>(len, out->payloadlen);
+        }
+#else
+        (void) buffer; (void) size; (void) address;
+#endif
+        return -1;
+    }
+
+    /* Queues datagram, it is sent on next submit(). Returns false when it can't be queued */
+    bool send(const uint8_t* datagram, uint16_t datagram_len,
+              const struct sockaddr_in* address) {
+#ifdef PROJEKT2_HAVE_IO_URING
+        while (free_send_slots.empty()) {
+            /* Every slot is in flight, wait until kernel finishes some of them */
+            syscall(__NR_io_uring_enter, ring_fd, to_submit, 1,
+                    IORING_ENTER_GETEVENTS, nullptr, 0);
+            to_submit = sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+            reap_completions();
+        }
+
+        struct io_uring_sqe* sqe = get_sqe();
+        if (sqe == nullptr)
+            return false;
+        uint32_t slot_id = free_send_slots.back();
+        free_send_slots.pop_back();
+        SendSlot& slot = send_slots[slot_id];
+        slot.data.assign(datagram, datagram + datagram_len);
+        slot.address = *address;
+        slot.iov = {slot.data.data(), datagram_len};
+        slot.msg = {};
+        slot.msg.msg_name = &slot.address;
+        slot.msg.msg_namelen = sizeof(slot.address);
+        slot.msg.msg_iov = &slot.iov;
+        slot.msg.msg_iovlen = 1;
+
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = sock;
+        sqe->addr = (uint64_t) &slot.msg;
+        sqe->len = 1;
+        sqe->user_data = slot_id;
+        return true;
+#else
+        (void) datagram; (void) datagram_len; (void) address;
+        return false;
+#endif
+    }
+
+    bool has_received() const {
+#ifdef PROJEKT2_HAVE_IO_URING
+        return !received.empty();
+#else
+        return false;
+#endif
+    }
+
+    /*
+     * Stops multishot receive and waits until kernel confirms it and finishes
+     * every queued send. Datagrams not taken yet stay in the socket.
+     */
+    void stop() {
+#ifdef PROJEKT2_HAVE_IO_URING
+        receiving = false;
+        struct io_uring_sqe* sqe;
+        while ((sqe = get_sqe()) == nullptr) {
+            /* Kernel didn't take queued operations, wait for some to finish */
+            syscall(__NR_io_uring_enter, ring_fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            reap_completions();
+        }
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = RECV_USER_DATA;
+        sqe->user_data = CANCEL_USER_DATA;
+
+        while (!receive_stopped || free_send_slots.size() < send_slots.size()) {
+            syscall(__NR_io_uring_enter, ring_fd, to_submit, 1,
+                    IORING_ENTER_GETEVENTS, nullptr, 0);
+            to_submit = sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+            reap_completions();
+        }
+#endif
+    }
+
+    /* Submits every queued operation with single syscall */
+    bool submit() {
+#ifdef PROJEKT2_HAVE_IO_URING
+        if (to_submit == 0)
+            return true;
+        long res = syscall(__NR_io_uring_enter, ring_fd, to_submit, 0, 0, nullptr, 0);
+        if (res < 0) {
+            std::cerr << "Submitting io_uring queue failed!" << std::endl;
+            return false;
+        }
+        to_submit -= res;
+        return true;
+#else
+        return false;
+#endif
+    }
+
+private:
+#ifdef PROJEKT2_HAVE_IO_URING
+    bool init_ring() {
+        struct io_uring_params params{};
+        ring_fd = (int) syscall(__NR_io_uring_setup, RING_ENTRIES, &params);
+        if (ring_fd < 0)
+            return false;
+        if (!(params.features & IORING_FEAT_SINGLE_MMAP))
+            return fail_init();
+
+        sq_ring_size = std::max(params.sq_off.array + params.sq_entries * sizeof(uint32_t),
+                                params.cq_off.cqes +
+                                params.cq_entries * sizeof(struct io_uring_cqe));
+        sq_ring_ptr = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+        if (sq_ring_ptr == MAP_FAILED) {
+            sq_ring_ptr = nullptr;
+            return fail_init();
+        }
+        sqes = (struct io_uring_sqe*) mmap(nullptr,
+                                           params.sq_entries * sizeof(struct io_uring_sqe),
+                                           PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                           ring_fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            sqes = nullptr;
+            return fail_init();
+        }
+
+        auto ring = (uint8_t*) sq_ring_ptr;
+        sq_head = (uint32_t*) (ring + params.sq_off.head);
+        sq_tail = (uint32_t*) (ring + params.sq_off.tail);
+        sq_array = (uint32_t*) (ring + params.sq_off.array);
+        sq_mask = *(uint32_t*) (ring + params.sq_off.ring_mask);
+        sq_entries = params.sq_entries;
+        sq_local_tail = *sq_tail;
+        cq_head = (uint32_t*) (ring + params.cq_off.head);
+        cq_tail = (uint32_t*) (ring + params.cq_off.tail);
+        cq_mask = *(uint32_t*) (ring + params.cq_off.ring_mask);
+        cqes = (struct io_uring_cqe*) (ring + params.cq_off.cqes);
+        return true;
+    }
+
+    bool init_buffer_ring() {
+        buf_ring_size = RECV_BUFFERS * sizeof(struct io_uring_buf);
+        void* ptr = mmap(nullptr, buf_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED)
+            return fail_init();
+        buf_ring = (struct io_uring_buf_ring*) ptr;
+
+        struct io_uring_buf_reg reg{};
+        reg.ring_addr = (uint64_t) buf_ring;
+        reg.ring_entries = RECV_BUFFERS;
+        reg.bgid = RECV_BUFFER_GROUP;
+        if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+            return fail_init(); // Kernel older than 5.19
+
+        recv_buffers.resize(RECV_BUFFERS * RECV_BUFFER_SIZE);
+        for (uint16_t i = 0; i < RECV_BUFFERS; ++i)
+            recycle_buffer(i);
+
+        /* Kernel lays out name and payload after io_uring_recvmsg_out */
+        recv_msg.msg_namelen = sizeof(struct sockaddr_in);
+        return true;
+    }
+
+    bool fail_init() {
+        close(ring_fd);
+        ring_fd = -1;
+        return false;
+    }
+
+    void recycle_buffer(uint16_t buffer_id) {
+        uint16_t tail = buf_ring->tail;
+        /* Not buf_ring->bufs, in C++ its flexible array header has nonzero size */
+        struct io_uring_buf* buf =
+                (struct io_uring_buf*) buf_ring + (tail & (RECV_BUFFERS - 1));
+        buf->addr = (uint64_t) (recv_buffers.data() + buffer_id * RECV_BUFFER_SIZE);
+        buf->len = RECV_BUFFER_SIZE;
+        buf->bid = buffer_id;
+        __atomic_store_n(&buf_ring->tail, tail + 1, __ATOMIC_RELEASE);
+    }
+
+    bool arm_receive() {
+        struct io_uring_sqe* sqe = get_sqe();
+        if (sqe == nullptr)
+            return false;
+        sqe->opcode = IORING_OP_RECVMSG;
+        sqe->fd = sock;
+        sqe->addr = (uint64_t) &recv_msg;
+        sqe->len = 1;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = RECV_BUFFER_GROUP;
+        sqe->user_data = RECV_USER_DATA;
+        return true;
+    }
+
+    /* Returns nullptr when queue is full and submitting it failed */
+    struct io_uring_sqe* get_sqe() {
+        if (sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) == sq_entries &&
+            (!submit() || sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) == sq_entries))
+            return nullptr;
+
+        uint32_t index = sq_local_tail & sq_mask;
+        struct io_uring_sqe* sqe = &sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sq_array[index] = index;
+        sq_local_tail++;
+        to_submit++;
+        __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+        return sqe;
+    }
+
+    void complete_send(const struct io_uring_cqe& cqe) {
+        auto slot_id = (uint32_t) cqe.user_data;
+        if (cqe.res < 0) {
+            // Just report error, no need to stop program
+            std::cerr << "Sending buffer to " << send_slots[slot_id].address.sin_addr.s_addr
+                      << ":" << send_slots[slot_id].address.sin_port << " failed!" << std::endl;
+        }
+        free_send_slots.push_back(slot_id);
+    }
+
+    /* Frees slots of finished sends and stores receive completions */
+    void reap_completions() {
+        uint32_t head = *cq_head;
+        while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+            const struct io_uring_cqe& cqe = cqes[head & cq_mask];
+            if (cqe.user_data == RECV_USER_DATA) {
+                received.push_back(cqe);
+                if (!(cqe.flags & IORING_CQE_F_MORE) && !receiving)
+                    receive_stopped = true;
+            }
+            else if (cqe.user_data != CANCEL_USER_DATA) {
+                complete_send(cqe);
+            }
+            head++;
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    }
+#endif
+
+};
+
+#endif //PROJEKT2_URING_SOCKET_H
@@ -55,7 +55,7 @@ const uint32_t crc32_tab[] = {
         0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
 };
 
-uint32_t generate_crc32(uint8_t *buf, std::size_t size) {
+uint32_t generate_crc32(const uint8_t *buf, std::size_t size) {
     uint32_t crc = ~0U;
 
     while (size--)
@@ -0,0 +1,125 @@
+#ifndef PROJEKT2_WIRE_SCHEMA_H
+#define PROJEKT2_WIRE_SCHEMA_H
+
+#include <cstdint>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "consts.h"
+#include "utils.h"
+
+/*
+ * Wire format of event records, described once for server and client:
+ *   len(4) event_no(4) event_type(1) fields [names] crc32(4)
+ * len counts bytes from event_no to the end of names, crc32 covers len too.
+ * Every event type is a WireSchema of its fixed fields. Their offsets and
+ * lengths are computed at compile time, encoding and decoding of fixed part
+ * has no branches. NEW_GAME ends with names, each followed by '\0'.
+ */
+
+/* Unsigned integer from host to network byte order, or back */
+template<typename T>
+constexpr T swap_wire_order(T value) {
+    static_assert(std::is_unsigned_v<T>, "Wire integers are unsigned");
+    if constexpr (sizeof(T) == 1 || __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+        return value;
+    else if constexpr (sizeof(T) == 2)
+        return __builtin_bswap16(value);
+    else if constexpr (sizeof(T) == 4)
+        return __builtin_bswap32(value);
+    else
+        return __builtin_bswap64(value);
+}
+
+/* Integer at any alignment, in network byte order */
+template<typename T>
+T load_wire(const uint8_t* in) {
+    T value;
+    memcpy(&value, in, sizeof(value));
+    return swap_wire_order(value);
+}
+
+template<typename T>
+void store_wire(uint8_t* out, T value) {
+    value = swap_wire_order(value);
+    memcpy(out, &value, sizeof(value));
+}
+
+/* Header of every record: len, event_no and event_type */
+const uint32_t WIRE_HEADER_LENGTH = 9;
+
+template<uint8_t EVENT_TYPE, bool HAS_NAMES, typename... Fields>
+class WireSchema {
+
+    static constexpr uint32_t get_offset(size_t field) {
+        constexpr uint32_t sizes[] = {sizeof(Fields)..., 0};
+        uint32_t offset = WIRE_HEADER_LENGTH;
+        for (size_t i = 0; i < field; ++i)
+            offset += sizes[i];
+        return offset;
+    }
+
+    template<size_t FIELD>
+    static constexpr uint32_t offset = get_offset(FIELD);
+
+    template<size_t... FIELD>
+    static void encode_fields([[maybe_unused]] uint8_t* out, std::index_sequence<FIELD...>,
+                              Fields... fields) {
+        (store_wire<Fields>(out + offset<FIELD>, fields), ...);
+    }
+
+    template<size_t... FIELD>
+    static std::tuple<Fields...> decode_fields([[maybe_unused]] const uint8_t* in,
+                                               std::index_sequence<FIELD...>) {
+        return std::tuple<Fields...>(load_wire<Fields>(in + offset<FIELD>)...);
+    }
+
+public:
+    static constexpr uint8_t event_type = EVENT_TYPE;
+    static constexpr bool has_names = HAS_NAMES;
+
+    /* Value of len without names, also the smallest valid one */
+    static constexpr uint32_t length = get_offset(sizeof...(Fields)) - 4;
+
+    /* Position of names in record, or of crc32 when there are none */
+    static constexpr uint32_t fields_end = length + 4;
+
+    /* Writes record up to names, returns fields_end */
+    static uint32_t encode(uint8_t* out, uint32_t event_no, uint32_t names_length,
+                           Fields... fields) {
+        store_wire<uint32_t>(out, length + names_length);
+        store_wire<uint32_t>(out + 4, event_no);
+        out[8] = EVENT_TYPE;
+        encode_fields(out, std::index_sequence_for<Fields...>{}, fields...);
+        return fields_end;
+    }
+
+    /* Fields of record starting at in, which has to be at least length long */
+    static std::tuple<Fields...> decode(const uint8_t* in) {
+        return decode_fields(in, std::index_sequence_for<Fields...>{});
+    }
+
+};
+
+using NewGameWire = WireSchema<NEW_GAME, true, uint32_t, uint32_t>; // maxx, maxy
+using PixelWire = WireSchema<PIXEL, false, uint8_t, uint32_t, uint32_t>; // player_number, x, y
+using PlayerEliminatedWire = WireSchema<PLAYER_ELIMINATED, false, uint8_t>; // player_number
+using GameOverWire = WireSchema<GAME_OVER, false>;
+
+/* len without names, indexed by event_type */
+constexpr uint32_t WIRE_LENGTHS[] = {NewGameWire::length, PixelWire::length,
+                                     PlayerEliminatedWire::length, GameOverWire::length};
+
+static_assert(NewGameWire::length == 13 && PixelWire::length == 14 &&
+              PlayerEliminatedWire::length == 6 && GameOverWire::length == 5,
+              "Wire format of events changed");
+
+/* Appends crc32 of record written up to pos, returns length of whole record */
+inline uint32_t finish_wire_record(uint8_t* record, uint32_t pos) {
+    store_wire<uint32_t>(record + pos, generate_crc32(record, pos));
+    return pos + 4;
+}
+
+#endif //PROJEKT2_WIRE_SCHEMA_H
@@ -0,0 +1,124 @@
+#ifndef PROJEKT2_WORK_STEALING_POOL_H
+#define PROJEKT2_WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Runs task for every index of a range on fixed set of threads. Every thread
+ * gets equal part of the range and takes small chunks from it, thread which
+ * finished its part steals chunks from parts of the others. Calling thread
+ * works as one of them.
+ */
+class WorkStealingPool {
+
+    static const uint32_t CHUNK = 16;
+
+    class alignas(64) Part {
+
+    public:
+        std::atomic<uint32_t> next{};
+        uint32_t end{};
+
+    };
+
+    std::vector<std::thread> threads;
+    std::vector<Part> parts;
+    const std::function<void(uint32_t)>* task = nullptr;
+
+    std::mutex mutex;
+    std::condition_variable start_cv, done_cv;
+    uint64_t generation = 0;
+    uint32_t working = 0;
+    bool stopping = false;
+
+public:
+
+    /* 0 threads means one for every core */
+    explicit WorkStealingPool(uint32_t threads_number = 0)
+                : parts(get_threads_number(threads_number)) {
+        for (uint32_t i = 1; i < parts.size(); ++i)
+            threads.emplace_back([this, i]() { work(i); });
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        start_cv.notify_all();
+        for (auto& thread : threads)
+            thread.join();
+    }
+
+    uint32_t size() const {
+        return parts.size();
+    }
+
+    /* Returns when function was called for every index from 0 to tasks_number - 1 */
+    void run(uint32_t tasks_number, const std::function<void(uint32_t)>& function) {
+        for (uint32_t i = 0; i < parts.size(); ++i) {
+            parts[i].next.store((uint64_t) tasks_number * i / parts.size(),
+                                std::memory_order_relaxed);
+            parts[i].end = (uint64_t) tasks_number * (i + 1) / parts.size();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            task = &function;
+            working = parts.size() - 1;
+            generation++;
+        }
+        start_cv.notify_all();
+
+        process(0);
+        std::unique_lock<std::mutex> lock(mutex);
+        done_cv.wait(lock, [this]() { return working == 0; });
+    }
+
+private:
+    void work(uint32_t thread_no) {
+        uint64_t seen_generation = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                start_cv.wait(lock, [&]() { return stopping || generation != seen_generation; });
+                if (stopping)
+                    return;
+                seen_generation = generation;
+            }
+
+            process(thread_no);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--working == 0)
+                done_cv.notify_one();
+        }
+    }
+
+    /* Own part first, then parts of the others */
+    void process(uint32_t thread_no) {
+        for (uint32_t i = 0; i < parts.size(); ++i) {
+            Part& part = parts[(thread_no + i) % parts.size()];
+            uint32_t begin;
+            while ((begin = part.next.fetch_add(CHUNK, std::memory_order_relaxed)) < part.end)
+                for (uint32_t index = begin; index < begin + CHUNK && index < part.end; ++index)
+                    (*task)(index);
+        }
+    }
+
+    static uint32_t get_threads_number(uint32_t threads_number) {
+        if (threads_number == 0)
+            threads_number = std::thread::hardware_concurrency();
+        return threads_number == 0 ? 1 : threads_number;
+    }
+
+};
+
+#endif //PROJEKT2_WORK_STEALING_POOL_H